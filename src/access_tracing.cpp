@@ -24,14 +24,62 @@
  */
 
 #include "access_tracing.h"
-#include "bithacks.h"
+#include <algorithm>
+#include <fcntl.h>
 #include <hdf5.h>
 #include <hdf5_hl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bithacks.h"
+#include "hdf5_lock.h"
 
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
 
+bool IsNativeTraceName(const char* fname) {
+    size_t len = strlen(fname);
+    return len >= 4 && strcmp(fname + len - 4, ".raw") == 0;
+}
+
 AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
-    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    map = nullptr;
+    mapBytes = 0;
+    records = nullptr;
+    fid = table = -1;
+    prefetch = false;
+    nextBuf = nullptr;
+    curFrameRecord = 0;
+    cur = 0;
+
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) panic("Could not open trace file %s", fname.c_str());
+    uint64_t magic = 0;
+    bool native = ::read(fd, &magic, sizeof(magic)) == sizeof(magic) && magic == ACCESS_TRACE_MAGIC;
+
+    if (native) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(NativeTraceHeader)) panic("Could not stat trace file %s", fname.c_str());
+        mapBytes = st.st_size;
+        map = mmap(nullptr, mapBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) panic("Could not mmap trace file %s", fname.c_str());
+        close(fd);
+        madvise(map, mapBytes, MADV_SEQUENTIAL);
+
+        NativeTraceHeader* hdr = static_cast<NativeTraceHeader*>(map);
+        if (!hdr->finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+        numChildren = hdr->numChildren;
+        size_t recBytes = mapBytes - sizeof(NativeTraceHeader);
+        if (recBytes % sizeof(PackedAccessRecord)) panic("Trace file %s is truncated", fname.c_str());
+        numRecords = recBytes/sizeof(PackedAccessRecord);
+        records = reinterpret_cast<PackedAccessRecord*>(hdr + 1);
+        windowMap();
+        return;
+    }
+    close(fd);
+
+    fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
 
     // Check that the trace finished
@@ -44,7 +92,7 @@ AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str())
 
     // Populate numRecords & numChildren
     hsize_t nPackets;
-    hid_t table = H5PTopen(fid, "accs");
+    table = H5PTopen(fid, "accs");
     if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
     H5PTget_num_packets(table, &nPackets);
     numRecords = nPackets;
@@ -53,17 +101,72 @@ AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str())
     H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
     H5Aclose(ncAttr);
 
-    curFrameRecord = 0;
-    cur = 0;
     max = MIN(PT_CHUNKSIZE, numRecords);
     buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
 
-    if (max) {
-        H5PTread_packets(table, 0, max, buf);
+    if (max) readChunk(0, max, buf);
+}
+
+AccessTraceReader::~AccessTraceReader() {
+    assert(!prefetch || curFrameRecord >= numRecords);  // the helper thread must be done
+    if (map) {
+        munmap(map, mapBytes);
+    } else {
+        futex_lock(hdf5Lock());
+        H5PTclose(table);
+        H5Fclose(fid);
+        futex_unlock(hdf5Lock());
+        if (buf) gm_free(buf);
+        if (nextBuf) gm_free(nextBuf);
     }
+}
 
-    H5PTclose(table);
-    H5Fclose(fid);
+void AccessTraceReader::readChunk(uint64_t frame, uint32_t numPackets, PackedAccessRecord* dst) {
+    futex_lock(hdf5Lock());
+    herr_t err = H5PTread_packets(table, frame, numPackets, dst);
+    futex_unlock(hdf5Lock());
+    if (err < 0) panic("Could not read HDF5 trace %s (records %ld-%ld)", fname.c_str(), frame, frame + numPackets);
+}
+
+void AccessTraceReader::windowMap() {
+    buf = records + curFrameRecord;
+    max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
+
+    // Have the kernel read the next window in while this one is replayed, and drop the previous one
+    const uintptr_t pageMask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+    uintptr_t start = (uintptr_t)(buf + max) & pageMask;
+    uintptr_t end = (uintptr_t)(records + MIN(numRecords, curFrameRecord + max + PT_CHUNKSIZE));
+    if (end > start) madvise((void*)start, end - start, MADV_WILLNEED);
+    if (curFrameRecord) {
+        uintptr_t prevStart = (uintptr_t)(buf - PT_CHUNKSIZE) & pageMask;
+        uintptr_t prevEnd = (uintptr_t)buf & pageMask;
+        if (prevEnd > prevStart) madvise((void*)prevStart, prevEnd - prevStart, MADV_DONTNEED);
+    }
+}
+
+bool AccessTraceReader::startPrefetch() {
+    assert(curFrameRecord == 0 && cur == 0 && !prefetch);
+    if (map || numRecords <= max) return false;
+    nextBuf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+    nextMax = 0;
+    prefetchFrame = max;
+    futex_init(&readyLock);
+    futex_lock(&readyLock);
+    futex_init(&requestLock);
+    futex_lock(&requestLock);
+    prefetch = true;
+    return true;
+}
+
+void AccessTraceReader::prefetchLoop() {
+    assert(prefetch);
+    while (prefetchFrame < numRecords) {
+        nextMax = MIN(PT_CHUNKSIZE, numRecords - prefetchFrame);
+        readChunk(prefetchFrame, nextMax, nextBuf);
+        prefetchFrame += nextMax;
+        futex_unlock(&readyLock);
+        futex_lock_nospin(&requestLock);
+    }
 }
 
 void AccessTraceReader::nextChunk() {
@@ -72,21 +175,24 @@ void AccessTraceReader::nextChunk() {
 
     if (curFrameRecord < numRecords) {
         cur = 0;
-        max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
-        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
-        hid_t table = H5PTopen(fid, "accs");
-        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-        H5PTread_packets(table, curFrameRecord, max, buf);
-        H5PTclose(table);
-        H5Fclose(fid);
+        if (map) {
+            windowMap();
+        } else if (prefetch) {
+            futex_lock_nospin(&readyLock);  // usually already read
+            std::swap(buf, nextBuf);
+            max = nextMax;
+            futex_unlock(&requestLock);  // start on the next one
+        } else {
+            max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
+            readChunk(curFrameRecord, max, buf);
+        }
     } else {
         assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);  // aaand we're done
     }
 }
 
 
-AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
+void CreateHDF5Trace(const char* fname, uint32_t numChildren) {
     // Create record structure
     hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
     uint16_t val;
@@ -109,8 +215,8 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     insertType("childId", H5T_NATIVE_USHORT);
     insertType("accType", accType);
 
-    hid_t fid = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if (fid == H5I_INVALID_HID) panic("Could not create HDF5 file %s", fname.c_str());
+    hid_t fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not create HDF5 file %s", fname);
 
     // HACK: We want to use the SHUF filter... create the raw dataset instead of the packet table
     // hid_t table = H5PTcreate_fl(fid, "accs", recType, PT_CHUNKSIZE, 9);
@@ -143,15 +249,49 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     H5Aclose(fAttr);
 
     H5Fclose(fid);
+}
 
+AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
     // Initialize buffer
     buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
     cur = 0;
     max = PT_CHUNKSIZE;
     assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
+
+    native = IsNativeTraceName(fname.c_str());
+    if (native) {
+        FILE* f = fopen(fname.c_str(), "wb");
+        if (!f) panic("Could not create trace file %s", fname.c_str());
+        NativeTraceHeader hdr = {ACCESS_TRACE_MAGIC, numChildren, 0 /*unfinished*/};
+        if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+        fclose(f);
+        return;
+    }
+
+    CreateHDF5Trace(fname.c_str(), numChildren);
 }
 
 void AccessTraceWriter::dump(bool cont) {
+    if (native) {
+        // Reopened on every dump, as dumps may come from different processes
+        FILE* f = fopen(fname.c_str(), "r+b");
+        if (!f) panic("Could not open trace file %s", fname.c_str());
+        fseek(f, 0, SEEK_END);
+        if (fwrite(buf, sizeof(PackedAccessRecord), cur, f) != cur) panic("Could not write trace file %s", fname.c_str());
+        if (!cont) {
+            uint32_t finished = 1;
+            fseek(f, offsetof(NativeTraceHeader, finished), SEEK_SET);
+            if (fwrite(&finished, sizeof(finished), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+            gm_free(buf);
+            buf = nullptr;
+            max = 0;
+        }
+        cur = 0;
+        fclose(f);
+        return;
+    }
+
+    futex_lock(hdf5Lock());
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
     hid_t table = H5PTopen(fid, "accs");
@@ -173,4 +313,5 @@ void AccessTraceWriter::dump(bool cont) {
     cur = 0;
     H5PTclose(table);
     H5Fclose(fid);
+    futex_unlock(hdf5Lock());
 }
@@ -27,9 +27,27 @@
 #define ACCESS_TRACING_H_
 
 #include "g_std/g_string.h"
+#include "locks.h"
 #include "memory_hierarchy.h"
 
-/* HDF5-based classes read and write address traces in a consistent format */
+/* These classes read and write address traces in a consistent format. Traces
+ * are HDF5 files (compressed), or, if the file name ends in .raw, native
+ * traces: a NativeTraceHeader followed by the PackedAccessRecords, which
+ * readers mmap and replay in place. sorttrace converts between both.
+ */
+
+#define ACCESS_TRACE_MAGIC 0x314352544343415aul  // "ZACCTRC1"
+
+struct NativeTraceHeader {
+    uint64_t magic;
+    uint32_t numChildren;
+    uint32_t finished;
+};
+
+bool IsNativeTraceName(const char* fname);
+
+// Creates an empty, unfinished HDF5 trace: the chunked, shuffled and deflated accs dataset and its attributes
+void CreateHDF5Trace(const char* fname, uint32_t numChildren);
 
 struct AccessRecord {
     Address lineAddr;
@@ -59,8 +77,24 @@ class AccessTraceReader {
         uint64_t numRecords;
         uint32_t numChildren; //i.e., how many parallel streams does this file contain?
 
+        // Native traces: the whole file is mapped, and chunks are windows over it
+        void* map;
+        size_t mapBytes;
+        PackedAccessRecord* records;
+
+        // HDF5 traces: the file stays open. With prefetching, a helper thread
+        // reads the next chunk into nextBuf while the current one is replayed
+        int64_t fid, table;  // hid_t
+        volatile bool prefetch;
+        PackedAccessRecord* nextBuf;
+        uint32_t nextMax;
+        uint64_t prefetchFrame;
+        lock_t readyLock;  // unlocked by the helper when nextBuf is filled
+        lock_t requestLock;  // unlocked by the reader when nextBuf can be refilled
+
     public:
         AccessTraceReader(std::string fname);
+        ~AccessTraceReader();
 
         inline bool empty() const {return (cur == max);}
         uint32_t getNumChildren() const {return numChildren;}
@@ -74,8 +108,19 @@ class AccessTraceReader {
             return rec;
         }
 
+        // Starts reading ahead. Call before reading any records; if it returns
+        // true, run prefetchLoop() on a helper thread. Returns false if there
+        // is nothing to read ahead (native traces, or a single chunk)
+        bool startPrefetch();
+        void prefetchLoop();
+        static void PrefetchThreadTrampoline(void* arg) {
+            static_cast<AccessTraceReader*>(arg)->prefetchLoop();
+        }
+
     private:
         void nextChunk();
+        void readChunk(uint64_t frame, uint32_t numPackets, PackedAccessRecord* dst);
+        void windowMap();
 };
 
 class AccessTraceWriter : public GlobAlloc {
@@ -84,6 +129,7 @@ class AccessTraceWriter : public GlobAlloc {
         uint32_t cur;
         uint32_t max;
         g_string fname;
+        bool native;
 
     public:
         AccessTraceWriter(g_string fname, uint32_t numChildren);
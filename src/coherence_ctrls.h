@@ -34,6 +34,7 @@
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
+#include "stats_arena.h"
 
 //TODO: Now that we have a pure CC interface, the MESI controllers should go on different files.
 
@@ -86,13 +87,14 @@ class MESIBottomCC : public GlobAlloc {
         uint32_t numLines;
         uint32_t selfId;
 
-        //Profiling counters
-        Counter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
-        Counter profPUTS, profPUTX /*received from downstream*/;
-        Counter profINV, profINVX, profFWD /*received from upstream*/;
+        //Profiling counters, packed in a per-cache arena
+        StatArena* profArena;
+        ArenaCounter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
+        ArenaCounter profPUTS, profPUTX /*received from downstream*/;
+        ArenaCounter profINV, profINVX, profFWD /*received from upstream*/;
         //Counter profWBIncl, profWBCoh /* writebacks due to inclusion or coherence, received from downstream, does not include PUTS */;
         // TODO: Measuring writebacks is messy, do if needed
-        Counter profGETNextLevelLat, profGETNetLat;
+        ArenaCounter profGETNextLevelLat, profGETNetLat;
 
         bool nonInclusiveHack;
 
@@ -101,7 +103,7 @@ class MESIBottomCC : public GlobAlloc {
         PAD();
 
     public:
-        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack) {
+        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : numLines(_numLines), selfId(_selfId), profArena(nullptr), nonInclusiveHack(_nonInclusiveHack) {
             array = gm_calloc<MESIState>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i] = I;
@@ -117,18 +119,20 @@ class MESIBottomCC : public GlobAlloc {
         }
 
         void initStats(AggregateStat* parentStat) {
-            profGETSHit.init("hGETS", "GETS hits");
-            profGETXHit.init("hGETX", "GETX hits");
-            profGETSMiss.init("mGETS", "GETS misses");
-            profGETXMissIM.init("mGETXIM", "GETX I->M misses");
-            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)");
-            profPUTS.init("PUTS", "Clean evictions (from lower level)");
-            profPUTX.init("PUTX", "Dirty evictions (from lower level)");
-            profINV.init("INV", "Invalidates (from upper level)");
-            profINVX.init("INVX", "Downgrades (from upper level)");
-            profFWD.init("FWD", "Forwards (from upper level)");
-            profGETNextLevelLat.init("latGETnl", "GET request latency on next level");
-            profGETNetLat.init("latGETnet", "GET request latency on network to next level");
+            // Init in append order, so the dump order matches the arena layout and snapshots copy it in one go
+            profArena = new StatArena(12);
+            profGETSHit.init("hGETS", "GETS hits", profArena);
+            profGETXHit.init("hGETX", "GETX hits", profArena);
+            profGETSMiss.init("mGETS", "GETS misses", profArena);
+            profGETXMissIM.init("mGETXIM", "GETX I->M misses", profArena);
+            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)", profArena);
+            profPUTS.init("PUTS", "Clean evictions (from lower level)", profArena);
+            profPUTX.init("PUTX", "Dirty evictions (from lower level)", profArena);
+            profINV.init("INV", "Invalidates (from upper level)", profArena);
+            profINVX.init("INVX", "Downgrades (from upper level)", profArena);
+            profFWD.init("FWD", "Forwards (from upper level)", profArena);
+            profGETNextLevelLat.init("latGETnl", "GET request latency on next level", profArena);
+            profGETNetLat.init("latGETnet", "GET request latency on network to next level", profArena);
 
             parentStat->append(&profGETSHit);
             parentStat->append(&profGETXHit);
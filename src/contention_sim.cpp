@@ -58,10 +58,14 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, uint32_t _stealQuantum) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    workStealing = _workStealing;
+    stealQuantum = _stealQuantum;
+    assert(stealQuantum > 0);
     threadsDone = 0;
+    domainsDone = 0;
     limit = 0;
     lastLimit = 0;
     inCSim = false;
@@ -72,7 +76,9 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     for (uint32_t i = 0; i < numDomains; i++) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
-        futex_init(&domains[i].pqLock);
+        domains[i].inbox = nullptr;
+        domains[i].claimed = 0;
+        domains[i].finished = false;
     }
 
     if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
@@ -98,6 +104,76 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     }
 
     lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
+
+    domainLoads = gm_calloc<double>(numDomains);
+    crossingCounts = gm_calloc<uint64_t>(MAX_THREADS*8);
+
+    weaveTrace = nullptr;
+
+    deterministic = false;
+    srcInboxes = nullptr;
+    numSources = 0;
+    snapshotFile = nullptr;
+}
+
+void ContentionSim::initWeaveTrace(const char* fileName, uint32_t bufRecords, uint64_t startPhase, uint64_t numPhases) {
+    assert(!weaveTrace);
+    weaveTrace = new WeaveTrace(fileName, numDomains, bufRecords, startPhase, numPhases);
+}
+
+void ContentionSim::initDeterminism(bool orderedEnqueues, const char* snapshotFileName) {
+    deterministic = orderedEnqueues;
+    if (deterministic) {
+        numSources = MAX_THREADS + 1;
+        srcInboxes = gm_calloc<SourceInbox>(numDomains*numSources);
+        info("Deterministic weave: synced enqueues ordered by (cycle, srcId, seq)");
+    }
+    if (snapshotFileName) {
+        snapshotFile = fopen(snapshotFileName, "w");
+        if (!snapshotFile) panic("Could not open weave snapshot file %s", snapshotFileName);
+        fprintf(snapshotFile, "# phase domain events firstCycle digest\n");
+    }
+}
+
+uint32_t ContentionSim::assignDomain(double load) {
+    assert(load >= 0.0);
+    uint32_t bestThread = 0;
+    double bestThreadLoad = -1.0;
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        double threadLoad = 0.0;
+        for (uint32_t d = simThreads[i].firstDomain; d < simThreads[i].supDomain; d++) threadLoad += domainLoads[d];
+        if (bestThreadLoad < 0.0 || threadLoad < bestThreadLoad) {
+            bestThread = i;
+            bestThreadLoad = threadLoad;
+        }
+    }
+
+    uint32_t bestDomain = simThreads[bestThread].firstDomain;
+    for (uint32_t d = bestDomain + 1; d < simThreads[bestThread].supDomain; d++) {
+        if (domainLoads[d] < domainLoads[bestDomain]) bestDomain = d;
+    }
+    domainLoads[bestDomain] += load;
+    return bestDomain;
+}
+
+uint64_t ContentionSim::takePhaseCrossings() {
+    assert(!inCSim);
+    uint64_t res = 0;
+    for (uint32_t i = 0; i < MAX_THREADS; i++) {
+        res += crossingCounts[i*8];
+        crossingCounts[i*8] = 0;
+    }
+    return res;
+}
+
+uint32_t ContentionSim::getWeaveSkew() const {
+    uint64_t minNs = simThreads[0].lastPhaseNs;
+    uint64_t maxNs = minNs;
+    for (uint32_t i = 1; i < numSimThreads; i++) {
+        minNs = MIN(minNs, simThreads[i].lastPhaseNs);
+        maxNs = MAX(maxNs, simThreads[i].lastPhaseNs);
+    }
+    return maxNs? 100*(maxNs - minNs)/maxNs : 0;
 }
 
 void ContentionSim::postInit() {
@@ -140,6 +216,51 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         domStat->append(&domains[i].profTime);
         objStat->append(domStat);
     }
+
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Simulation thread stats");
+        static const char* stateNames[] = {"sleep", "busy", "idle"};
+        new (&simThreads[i].profState) TimeBreakdownStat();
+        simThreads[i].profState.init("state", "Host time (ns) sleeping between phases, simulating events, and waiting for work", ST_NUM, stateNames);
+        thStat->append(&simThreads[i].profState);
+        new (&simThreads[i].profSteals) Counter();
+        simThreads[i].profSteals.init("steals", "Domain slices stolen from other threads");
+        thStat->append(&simThreads[i].profSteals);
+        objStat->append(thStat);
+    }
+
+    //Event slab pools, summed over all recorders (recorders are registered after this)
+    AggregateStat* poolStat = new AggregateStat();
+    poolStat->init("evPool", "Event slab pool stats");
+    auto sumPools = [](bool mem, bool reuses) {
+        uint64_t res = 0;
+        for (uint32_t i = 0; i < zinfo->numCores; i++) {
+            EventRecorder* evRec = zinfo->eventRecorders[i];
+            if (!evRec) continue;
+            const slab::SlabAlloc& sa = mem? evRec->getMemSlabAlloc() : evRec->getSlabAlloc();
+            res += reuses? sa.getSlabReuses() : sa.getSlabAllocs();
+        }
+        return res;
+    };
+    auto allocsStat = makeLambdaStat([sumPools]() { return sumPools(false, false); });
+    allocsStat->init("allocs", "Core event slabs handed out");
+    poolStat->append(allocsStat);
+    auto reusesStat = makeLambdaStat([sumPools]() { return sumPools(false, true); });
+    reusesStat->init("reuses", "Core event slabs served from the free pool");
+    poolStat->append(reusesStat);
+    auto memAllocsStat = makeLambdaStat([sumPools]() { return sumPools(true, false); });
+    memAllocsStat->init("memAllocs", "Memory event slabs handed out");
+    poolStat->append(memAllocsStat);
+    auto memReusesStat = makeLambdaStat([sumPools]() { return sumPools(true, true); });
+    memReusesStat->init("memReuses", "Memory event slabs served from the free pool");
+    poolStat->append(memReusesStat);
+    objStat->append(poolStat);
+
+    if (weaveTrace) weaveTrace->initStats(objStat);
+
     parentStat->append(objStat);
 }
 
@@ -157,6 +278,20 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (workStealing) {
+        for (uint32_t i = 0; i < numDomains; i++) domains[i].finished = false;
+        domainsDone = 0;
+    }
+
+    //Fill the domain queues here, in a fixed order, so that snapshots see every event
+    if (deterministic || snapshotFile) {
+        if (deterministic) drainSourceInboxes();
+        for (uint32_t i = 0; i < numDomains; i++) drainInbox(&domains[i]);
+        if (snapshotFile) dumpQueueSnapshot();
+    }
+
+    if (weaveTrace && weaveTrace->beginPhase(zinfo->numPhases, limit)) TimingEvent::trace = weaveTrace;
+
     inCSim = true;
     __sync_synchronize();
 
@@ -171,6 +306,11 @@ void ContentionSim::simulatePhase(uint64_t limit) {
     inCSim = false;
     __sync_synchronize();
 
+    if (TimingEvent::trace) {
+        TimingEvent::trace = nullptr;
+        weaveTrace->endPhase();
+    }
+
     for (uint32_t i = 0; i < zinfo->numCores; i++) {
         TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
         if (tcore) tcore->cSimEnd();
@@ -178,6 +318,11 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimEnd();
     }
 
+    //All events of this phase are done; return their slabs to the pools in bulk
+    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+        if (zinfo->eventRecorders[i]) zinfo->eventRecorders[i]->recycle();
+    }
+
     lastLimit = limit;
     __sync_synchronize();
 }
@@ -187,7 +332,7 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(ev);
     assert_msg(cycle >= lastLimit, "Enqueued event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
 
     assert_msg(cycle >= domains[ev->domain].curCycle, "Queued event goes back in time, cycle %ld curCycle %ld", cycle, domains[ev->domain].curCycle);
     ev->privCycle = cycle;
@@ -198,22 +343,98 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     domains[ev->domain].pq.enqueue(ev, cycle);
 }
 
-void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle, uint32_t srcId) {
     assert(!inCSim);
     assert(ev && ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
-    uint32_t domain = ev->domain;
-
-    futex_lock(&domains[domain].pqLock);
+    DomainData& domain = domains[ev->domain];
 
     assert_msg(cycle >= lastLimit, "Enqueued (synced) event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
     ev->privCycle = cycle;
     assert(ev->numParents == 0);
-    domains[ev->domain].pq.enqueue(ev, cycle);
+    assert(!ev->next);
+
+    if (deterministic) {
+        //Each source is simulated by one thread at a time, so its FIFO needs no synchronization
+        SourceInbox& si = srcInboxes[ev->domain*numSources + MIN(srcId, numSources - 1)];
+        if (si.tail) si.tail->next = ev;
+        else si.head = ev;
+        si.tail = ev;
+        return;
+    }
 
-    futex_unlock(&domains[domain].pqLock);
+    //MPSC push; the domain's pq is only touched by the sim thread, which drains the inbox before running the domain
+    TimingEvent* head;
+    do {
+        head = domain.inbox;
+        ev->next = head;
+    } while (!__sync_bool_compare_and_swap(&domain.inbox, head, ev));
+}
+
+void ContentionSim::drainInbox(DomainData* domain) {
+    if (!domain->inbox) return;
+    TimingEvent* ev = __sync_lock_test_and_set(&domain->inbox, nullptr);
+    while (ev) {
+        TimingEvent* next = ev->next;
+        ev->next = nullptr;
+        domain->pq.enqueue(ev, ev->privCycle);
+        ev = next;
+    }
+}
+
+void ContentionSim::drainSourceInboxes() {
+    for (uint32_t d = 0; d < numDomains; d++) {
+        orderedEnqueues.clear();
+        for (uint32_t src = 0; src < numSources; src++) {
+            SourceInbox& si = srcInboxes[d*numSources + src];
+            uint32_t seq = 0;
+            TimingEvent* ev = si.head;
+            while (ev) {
+                TimingEvent* next = ev->next;
+                ev->next = nullptr;
+                orderedEnqueues.push_back({ev->privCycle, src, seq++, ev});
+                ev = next;
+            }
+            si.head = si.tail = nullptr;
+        }
+        if (orderedEnqueues.empty()) continue;
+
+        //Same-cycle events dequeue in LIFO order, so insert them from last to first
+        std::sort(orderedEnqueues.begin(), orderedEnqueues.end(), [](const OrderedEnqueue& a, const OrderedEnqueue& b) {
+            if (a.cycle != b.cycle) return a.cycle > b.cycle;
+            if (a.srcId != b.srcId) return a.srcId > b.srcId;
+            return a.seq > b.seq;
+        });
+        for (OrderedEnqueue& oe : orderedEnqueues) domains[d].pq.enqueue(oe.ev, oe.cycle);
+    }
+}
+
+//One line per domain with the number of queued events and an order-sensitive hash of their
+//cycles and types. Event addresses are left out, as they differ across runs; diff the files
+//of two runs to find the first phase and domain where they diverge. This is a digest, not a
+//restorable image: queued events point into live component state.
+void ContentionSim::dumpQueueSnapshot() {
+    for (uint32_t d = 0; d < numDomains; d++) {
+        uint64_t events = 0;
+        uint64_t firstCycle = 0;
+        uint64_t digest = 0xcbf29ce484222325ul;  // FNV-1a
+        auto hashWord = [&digest](uint64_t w) {
+            for (uint32_t i = 0; i < 8; i++) {
+                digest ^= (w >> (8*i)) & 0xff;
+                digest *= 0x100000001b3ul;
+            }
+        };
+        domains[d].pq.forEach([&](TimingEvent* ev, uint64_t cycle) {
+            if (!events || cycle < firstCycle) firstCycle = cycle;
+            events++;
+            hashWord(cycle);
+            for (const char* c = typeid(*ev).name(); *c; c++) hashWord(*c);
+        });
+        fprintf(snapshotFile, "%ld %d %ld %ld %016lx\n", zinfo->numPhases, d, events, firstCycle, digest);
+    }
+    fflush(snapshotFile);
 }
 
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
@@ -232,6 +453,7 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
 
     if (!isResp) cs.push_back(ev);
     else cs.pop_back();
+    crossingCounts[srcId*8]++; //srcId is only simulated by one thread at a time
 
     if (isResp) {
         req->parentEv->addChild(ev, evRec);
@@ -246,7 +468,7 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
             //We can't queue --- queue directly (synced, we're in phase 1)
             assert(cycle >= srcDomCycle);
             //info("Queuing xing %ld %ld (lst eve too old at cycle %ld)", cycle, srcDomCycle, last->cycle);
-            enqueueSynced(ev, cycle);
+            enqueueSynced(ev, cycle, srcId);
         }
         //Store this one as the last req
         last->cycle = cycle;
@@ -275,9 +497,14 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
             break;
         }
 
+        simThreads[thid].profState.transition(ST_BUSY);
+        uint64_t startNs = getNs();
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (workStealing) simulatePhaseStealing(thid);
+        else simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
+        simThreads[thid].lastPhaseNs = getNs() - startNs;
+        simThreads[thid].profState.transition(ST_SLEEP);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
         if (val == numSimThreads) {
@@ -289,6 +516,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
 }
 
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
+    for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) drainInbox(&domains[i]);
+
     uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
     uint32_t numFinished = 0;
 	//printf("thDomains = %d\n", thDomains);
@@ -413,6 +642,81 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Work-stealing weave phase. Domains can run on any thread, as long as only
+ * one thread runs each domain at a time: crossings only read the source
+ * domain's curCycle, and there are no cross-domain enqueues during the weave
+ * phase, so any interleaving of domain slices is valid. Each thread runs the
+ * laggard among its own domains, and once none is available, steals one from
+ * other threads. Slices end early when the domain stalls on a crossing, so
+ * the thread can advance the domain it waits on.
+ */
+void ContentionSim::simulatePhaseStealing(uint32_t thid) {
+    SimThreadData& th = simThreads[thid];
+    while (domainsDone < numDomains) {
+        DomainData* domain = claimDomain(th.firstDomain, th.supDomain);
+        for (uint32_t i = 1; i < numSimThreads && !domain; i++) {
+            SimThreadData& victim = simThreads[(thid + i) % numSimThreads];
+            domain = claimDomain(victim.firstDomain, victim.supDomain);
+            if (domain) th.profSteals.inc();
+        }
+
+        if (!domain) {
+            th.profState.transition(ST_IDLE);
+            _mm_pause();
+            continue;
+        }
+
+        th.profState.transition(ST_BUSY);
+        simulateDomainSlice(domain);
+        __sync_synchronize(); //publish the domain's state before releasing it
+        domain->claimed = 0;
+    }
+    th.profState.transition(ST_BUSY);
+}
+
+//Claims the unfinished domain in [firstDomain, supDomain) with the lowest
+//cycle, preferring domains not stalled on a crossing. nullptr if none or we lose the race.
+ContentionSim::DomainData* ContentionSim::claimDomain(uint32_t firstDomain, uint32_t supDomain) {
+    DomainData* best = nullptr;
+    for (uint32_t i = firstDomain; i < supDomain; i++) {
+        DomainData* d = &domains[i];
+        if (d->finished || d->claimed) continue;
+        if (!best || (d->prio == 0 && best->prio != 0) ||
+                ((d->prio == 0) == (best->prio == 0) && d->curCycle < best->curCycle)) {
+            best = d;
+        }
+    }
+    if (best && __sync_bool_compare_and_swap(&best->claimed, 0, 1)) {
+        if (!best->finished) return best;
+        best->claimed = 0; //finished between the scan and the claim
+    }
+    return nullptr;
+}
+
+void ContentionSim::simulateDomainSlice(DomainData* domain) {
+    domain->profTime.start();
+    drainInbox(domain);
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+    uint32_t events = 0;
+    while (pq.size() && pq.firstCycle() < limit) {
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        assert(cycle >= domain->curCycle);
+        if (cycle != domain->curCycle) domain->curCycle = cycle;
+        te->run(cycle);
+        uint64_t newCycle = pq.size()? MIN(pq.firstCycle(), limit) : limit;
+        if (newCycle != domain->curCycle) domain->curCycle = newCycle;
+        if (++events >= stealQuantum || domain->prio != 0) break;
+    }
+
+    if (!pq.size() || pq.firstCycle() >= limit) {
+        domain->curCycle = limit;
+        domain->finished = true;
+        __sync_fetch_and_add(&domainsDone, 1);
+    }
+    domain->profTime.end();
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -38,6 +38,7 @@
 #include "prio_queue.h"
 #include "profile_stats.h"
 #include "stats.h"
+#include "weave_trace.h"
 
 //Set to 1 to produce stats of how many event crossings are generated and run. Useful for debugging, but adds overhead.
 #define PROFILE_CROSSINGS 0
@@ -62,13 +63,19 @@ class ContentionSim : public GlobAlloc {
 
         CrossingEventInfo* lastCrossing; //indexed by [srcId*doms*doms + srcDom*doms + dstDom]
 
+        double* domainLoads; //expected load of the objects placed on each domain (fixed placements and assignDomain())
+
+        uint64_t* crossingCounts; //crossings enqueued this phase, indexed by [srcId*8] (one line per source)
+
         struct DomainData : public GlobAlloc {
             PrioQueue<TimingEvent, PQ_BLOCKS> pq;
 
             PAD();
 
             volatile uint64_t curCycle;
-            lock_t pqLock; //used on phase 1 enqueues
+            TimingEvent* volatile inbox; //lock-free stack of phase 1 (synced) enqueues, linked through next; drained into pq by the sim thread
+            volatile uint32_t claimed; //work-stealing mode: set while a sim thread runs this domain
+            volatile bool finished; //work-stealing mode: no events left before limit in this phase
             //lock_t domainLock; //used by simulation thread
 
             uint32_t prio;
@@ -89,12 +96,18 @@ class ContentionSim : public GlobAlloc {
              bool operator()(DomainData* d1, DomainData* d2) const;
         };
 
+        enum SimThreadState {ST_SLEEP, ST_BUSY, ST_IDLE, ST_NUM};
+
         struct SimThreadData {
             lock_t wakeLock; //used to sleep/wake up simulation thread
             uint32_t firstDomain;
             uint32_t supDomain; //supreme, ie first not included
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            TimeBreakdownStat profState; //sleep/busy/idle host time, indexed by SimThreadState
+            uint64_t lastPhaseNs; //host time spent simulating the last phase
+            Counter profSteals; //slices run on domains owned by other threads
         };
 
         //RO
@@ -107,6 +120,11 @@ class ContentionSim : public GlobAlloc {
         uint32_t numSimThreads;
         bool skipContention;
 
+        //Work-stealing mode: threads run domains in slices of up to stealQuantum
+        //events, and once their own domains are done, take other threads' domains
+        bool workStealing;
+        uint32_t stealQuantum;
+
         PAD();
 
         //RW
@@ -116,6 +134,7 @@ class ContentionSim : public GlobAlloc {
         volatile bool terminate;
 
         volatile uint32_t threadsDone;
+        volatile uint32_t domainsDone; //work-stealing mode only
         volatile uint32_t threadTicket; //used only at init
 
         volatile bool inCSim; //true when inside contention simulation
@@ -125,15 +144,49 @@ class ContentionSim : public GlobAlloc {
         //lock_t testLock;
         lock_t postMortemLock;
 
+        WeaveTrace* weaveTrace; //nullptr unless sim.weaveTrace
+
+        //Deterministic mode: synced enqueues go to per-source FIFOs instead of the
+        //inboxes, and are moved to the domain queues in (cycle, srcId, seq) order
+        struct SourceInbox {
+            TimingEvent* head;
+            TimingEvent* tail;
+        };
+
+        struct OrderedEnqueue {
+            uint64_t cycle;
+            uint32_t srcId;
+            uint32_t seq;
+            TimingEvent* ev;
+        };
+
+        bool deterministic;
+        SourceInbox* srcInboxes; //indexed by [domain*numSources + srcId]; the last source takes enqueues without a srcId
+        uint32_t numSources;
+        g_vector<OrderedEnqueue> orderedEnqueues;
+
+        FILE* snapshotFile; //per-domain queue digests at each phase boundary, nullptr if disabled
+
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing = false, uint32_t _stealQuantum = 256);
 
         void initStats(AggregateStat* parentStat);
 
         void postInit(); //must be called after the simulator is initialized
 
+        //Enables the binary weave event trace (see weave_trace.h); call before initStats
+        void initWeaveTrace(const char* fileName, uint32_t bufRecords, uint64_t startPhase, uint64_t numPhases);
+
+        //Makes the order of events in the weave independent of how bound-phase threads interleave,
+        //and/or dumps a digest of each domain's queue at every phase boundary (snapshotFileName
+        //may be nullptr). Snapshots are for comparing runs only; they cannot be restored from.
+        //Call before anything is enqueued
+        void initDeterminism(bool orderedEnqueues, const char* snapshotFileName);
+
         void enqueue(TimingEvent* ev, uint64_t cycle);
-        void enqueueSynced(TimingEvent* ev, uint64_t cycle);
+        //srcId identifies the bound-phase source (e.g., core) doing the enqueue; it only matters in
+        //deterministic mode, and can be omitted only for enqueues done while the system is initialized
+        void enqueueSynced(TimingEvent* ev, uint64_t cycle, uint32_t srcId = (uint32_t)-1);
         void enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec);
 
         void simulatePhase(uint64_t limit);
@@ -151,6 +204,26 @@ class ContentionSim : public GlobAlloc {
 
         void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
 
+        //Picks a domain for an object with the given expected load: the least
+        //loaded domain of the least loaded simulation thread. Objects of equal
+        //load get distinct domains while there are free ones, spread across threads.
+        uint32_t assignDomain(double load);
+
+        //Accounts for the load of an object placed on a fixed domain (cores,
+        //caches), so later assignDomain() calls balance around it
+        void addDomainLoad(uint32_t domain, double load) {
+            assert(domain < numDomains && load >= 0.0);
+            domainLoads[domain] += load;
+        }
+
+        uint32_t getNumSimThreads() const {return numSimThreads;}
+
+        //Crossing events produced since the last call; call only between phases
+        uint64_t takePhaseCrossings();
+
+        //Imbalance of the last weave phase across sim threads, in % of the busiest thread's time
+        uint32_t getWeaveSkew() const;
+
 #if PROFILE_CROSSINGS
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
             domains[dstDomain].profIncomingCrossings.inc(srcDomain);
@@ -162,6 +235,12 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void simulatePhaseStealing(uint32_t thid);
+        DomainData* claimDomain(uint32_t firstDomain, uint32_t supDomain);
+        void simulateDomainSlice(DomainData* domain);
+        void drainInbox(DomainData* domain);
+        void drainSourceInboxes();
+        void dumpQueueSnapshot();
 
         static void SimThreadTrampoline(void* arg);
 };
@@ -77,7 +77,7 @@ uint64_t CoreRecorder::notifyJoin(uint64_t curCycle) {
         prevRespEvent = new (eventRecorder) TimingCoreEvent(0, curCycle, this, domain);
         prevRespCycle = curCycle;
         prevRespEvent->setMinStartCycle(curCycle);
-        prevRespEvent->queue(curCycle);
+        prevRespEvent->queue(curCycle, eventRecorder.getSourceId());
         eventRecorder.setStartSlack(0);
         DEBUG_MSG("[%s] Joined, was HALTED, curCycle %ld halted %ld", name.c_str(), curCycle, totalHaltedCycles);
     } else if (state == DRAINING) {
@@ -38,23 +38,84 @@
 //#define DEBUG(args...) info(args)
 #define DEBUG(args...)
 
-// Recorder-allocated event, represents one read or write request
-class DDRMemoryAccEvent : public TimingEvent {
+// Recorder-allocated event, represents one read or write request, or with chain
+// compaction, a sequence of same-direction requests to this controller (see MultiOpEvent)
+class DDRMemoryAccEvent : public MultiOpEvent {
     private:
+        struct Op {
+            Address addr;
+            uint32_t data_size;
+        };
+
         DDRMemory* mem;
         Address addr;
 		uint32_t data_size;
         bool write;
+        DDRMemoryAccEvent* coalescedNext;  // other reads served by the same (coalesced) command
+        uint64_t mergeSysCycle;  // if coalesced into another read's command, when it reached the controller
+        Op* chainOps;  // ops after the first, allocated from the recorder on the first append; current op is mirrored in addr/data_size
+
     public:
         DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, int32_t domain, uint32_t preDelay, uint32_t postDelay)
-            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite) {}
+            : MultiOpEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite),
+              coalescedNext(nullptr), mergeSysCycle(0), chainOps(nullptr) {}
 
         Address getAddr() const {return addr;}
         bool isWrite() const {return write;}
 		uint32_t getDataSize() const {return data_size;}
+        DDRMemory* getMem() const {return mem;}
+
+        DDRMemoryAccEvent* getCoalescedNext() const {return coalescedNext;}
+        void setCoalescedNext(DDRMemoryAccEvent* ev) {coalescedNext = ev;}
+        uint64_t getMergeSysCycle() const {return mergeSysCycle;}
+        void setMergeSysCycle(uint64_t cycle) {mergeSysCycle = cycle;}
         void simulate(uint64_t startCycle) {
             mem->enqueue(this, startCycle);
         }
+
+        // Chain compaction only folds requests in the same direction, so the event keeps the postDelay that
+        // the last event of the equivalent uncompacted chain would have
+        bool canAppend(bool isWrite, uint32_t maxOps) const {
+            return isWrite == write && getNumOps() < maxOps;
+        }
+
+        // Appends a request that starts when the previous one is done. minStartCycle is the one the request would
+        // get as a separate chained event.
+        void appendRequest(Address reqAddr, uint32_t reqDataSize, uint64_t minStartCycle, uint32_t maxOps, EventRecorder* evRec) {
+            assert(getNumOps() < maxOps);
+            if (!chainOps) chainOps = static_cast<Op*>(evRec->allocMem((maxOps - 1)*sizeof(Op)));
+            uint32_t op = appendOp();
+            chainOps[op - 1] = {reqAddr, reqDataSize};
+            setMinStartCycle(MAX(getMinStartCycle(), minStartCycle));
+        }
+
+        // Called by the controller instead of done() when the current request is done
+        void respond(uint64_t doneCycle) {
+            opDone(doneCycle);  // may free us
+        }
+
+    protected:
+        void loadOp(uint32_t op) {
+            assert(op > 0);
+            addr = chainOps[op - 1].addr;
+            data_size = chainOps[op - 1].data_size;
+            coalescedNext = nullptr;
+        }
+
+    public:
+        // Allocate from the recorder's memory event pool
+        void* operator new (size_t sz, EventRecorder* evRec) {
+            return evRec->allocMem(sz);
+        }
+
+        void operator delete(void*, size_t) {
+            panic("DDRMemoryAccEvent::delete should never be called");
+        }
+
+        //Placement delete... make ICC happy. This would only fire on an exception
+        void operator delete (void* p, EventRecorder* evRec) {
+            panic("DDRMemoryAccEvent::delete PLACEMENT delete called");
+        }
 };
 
 // Globally allocated event that calls us every tREFI cycles
@@ -158,8 +219,14 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
         uint32_t _domain, g_string& _name, uint32_t _tBL, double time_scale)
     : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank),
       controllerSysLatency(_controllerSysLatency), queueDepth(_queueDepth), rowHitLimit(_rowHitLimit),
-      deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
+      deferredWrites(_deferredWrites), domain(_domain), name(_name)
 {
+    pagePolicy = _closedPage? CLOSED : OPEN;
+    pageTimeout = 0;
+    rowHitEpoch = 0;
+    maxRowHitLimit = rowHitLimit;
+    epochCmds = epochRowHits = 0;
+
     sysFreqKHz = 1000 * _sysFreqMHz;
     initTech(tech, time_scale);  // sets all tXX and memFreqKHz
 	tBL = _tBL;
@@ -184,11 +251,37 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
 
     banks.resize(ranksPerChannel);
-    for (uint32_t i = 0; i < ranksPerChannel; i++) banks[i].resize(banksPerRank);
+    for (uint32_t i = 0; i < ranksPerChannel; i++) {
+        banks[i].resize(banksPerRank);
+        for (Bank& bank : banks[i]) {
+            bank.autoPreCycle = -1ul;
+            bank.hitPred = 0;
+        }
+    }
 
     rankActWindows.resize(ranksPerChannel);
     for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
 
+    coalesceWindow = 0;
+    maxCoalesceBursts = 0;
+    writeCombine = false;
+    compactChains = false;
+    maxChainOps = 0;
+
+    analytic = analyticCalibrate = false;
+    analyticScale = 1.0;
+    futex_init(&analyticLock);
+    analyticLastCycle = 0;
+    phaseReqs = phaseBusCycles = phaseBankCycles = 0;
+    busUtil = bankUtil = 0.0;
+    busService = bankService = 0.0;
+    modelQueueDelay = 0;
+
+    rankPowers.resize(ranksPerChannel);
+    for (uint32_t i = 0; i < ranksPerChannel; i++) rankPowers[i] = {0, 0, 0};
+    powerDownThreshold = 0;
+    selfRefreshThreshold = 0;
+
     // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
     uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
     uint32_t bankBits = ilog2(banksPerRank);
@@ -229,6 +322,65 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     eventFreelist = nullptr;
 }
 
+void DDRMemory::initPower(uint32_t _devicesPerRank, uint32_t _powerDownThreshold, uint32_t _selfRefreshThreshold) {
+    if (_devicesPerRank) devicesPerRank = _devicesPerRank;
+    powerDownThreshold = _powerDownThreshold;
+    selfRefreshThreshold = _selfRefreshThreshold;
+    if (powerDownThreshold && selfRefreshThreshold && selfRefreshThreshold <= powerDownThreshold) {
+        panic("%s: selfRefreshThreshold (%d) must be larger than powerDownThreshold (%d)", name.c_str(), selfRefreshThreshold, powerDownThreshold);
+    }
+    info("%s: %d devices/rank, power-down after %d, self-refresh after %d idle cycles (0 = never)",
+            name.c_str(), devicesPerRank, powerDownThreshold, selfRefreshThreshold);
+}
+
+void DDRMemory::initPagePolicy(const char* policy, uint32_t _pageTimeout, uint32_t _rowHitEpoch, uint32_t _maxRowHitLimit) {
+    std::string p(policy);
+    if (p == "closed") pagePolicy = CLOSED;
+    else if (p == "open") pagePolicy = OPEN;
+    else if (p == "adaptive") pagePolicy = ADAPTIVE;
+    else panic("%s: invalid pagePolicy %s (closed/open/adaptive)", name.c_str(), policy);
+
+    pageTimeout = _pageTimeout;
+    rowHitEpoch = _rowHitEpoch;
+    maxRowHitLimit = std::max(_maxRowHitLimit, rowHitLimit);
+    if (pagePolicy == ADAPTIVE) {
+        if (!rowHitEpoch) panic("%s: adaptive page policy needs rowHitEpoch > 0", name.c_str());
+        info("%s: adaptive page policy, timeout %d cycles, rowHitLimit %d..%d tuned every %d commands",
+                name.c_str(), pageTimeout, 1, maxRowHitLimit, rowHitEpoch);
+    }
+}
+
+void DDRMemory::initCoalescing(uint32_t _coalesceWindow, uint32_t _maxCoalesceBursts, bool _writeCombine) {
+    coalesceWindow = _coalesceWindow;
+    maxCoalesceBursts = _maxCoalesceBursts;
+    writeCombine = _writeCombine;
+    if (coalesceWindow && maxCoalesceBursts < 2) panic("%s: maxCoalesceBursts must be >= 2 to coalesce requests", name.c_str());
+    if (coalesceWindow || writeCombine) {
+        info("%s: coalescing same-row requests within %d cycles (max %d bursts), write-combining %s",
+                name.c_str(), coalesceWindow, maxCoalesceBursts, writeCombine? "on" : "off");
+    }
+}
+
+void DDRMemory::initChainCompaction(bool enable, uint32_t maxOps) {
+    compactChains = enable;
+    maxChainOps = maxOps;
+    if (compactChains) {
+        if (maxChainOps < 2) panic("%s: maxChainOps must be >= 2", name.c_str());
+        info("%s: compacting sequential request chains into multi-op events of up to %d requests", name.c_str(), maxChainOps);
+    }
+}
+
+void DDRMemory::initAnalytic(bool enable, bool calibrate, double scale) {
+    analytic = enable;
+    analyticCalibrate = calibrate && !enable;
+    analyticScale = scale;
+    if (analytic || analyticCalibrate) {
+        predOpenRow.resize(ranksPerChannel*banksPerRank);
+        for (auto& r : predOpenRow) r = -1L;
+        info("%s: analytic model %s (scale %.3f)", name.c_str(), analytic? "replaces this channel's weave simulation" : "runs for calibration", analyticScale);
+    }
+}
+
 void DDRMemory::initStats(AggregateStat* parentStat) {
     AggregateStat* memStats = new AggregateStat();
     memStats->init(name.c_str(), "Memory controller stats");
@@ -240,13 +392,100 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
+    profCoalesced.init("coalesced", "Requests merged into a pending same-row command"); memStats->append(&profCoalesced);
+    profWrCombined.init("wrCombined", "Writes combined with a pending write to the same line"); memStats->append(&profWrCombined);
+    if (compactChains) {
+        profChainOps.init("chainOps", "Chained requests folded into an existing multi-op event"); memStats->append(&profChainOps);
+    }
+    if (analytic || analyticCalibrate) {
+        AggregateStat* modelStats = new AggregateStat();
+        modelStats->init("model", "Analytic queueing model");
+        profModelRdLat.init("rdlat", "Modeled latency of read requests"); modelStats->append(&profModelRdLat);
+        profModelBaseRdLat.init("baseRdlat", "Minimum (bound-phase) latency of read requests"); modelStats->append(&profModelBaseRdLat);
+        profModelUpdates.init("ups", "Model load updates"); modelStats->append(&profModelUpdates);
+        profModelRdHits.init("rdhits", "Predicted read row hits"); modelStats->append(&profModelRdHits);
+        profModelWrHits.init("wrhits", "Predicted write row hits"); modelStats->append(&profModelWrHits);
+        if (analyticCalibrate) {
+            // Ratio of the event-driven to modeled delay beyond the minimum latency; use it as analyticScale
+            auto scale = [this]() {
+                uint64_t base = profModelBaseRdLat.get();
+                uint64_t measured = profTotalRdLat.get();
+                uint64_t modeled = profModelRdLat.get();
+                return (modeled > base && measured > base)? (measured - base)*1000/(modeled - base) : 0;
+            };
+            auto scaleStat = makeLambdaStat(scale);
+            scaleStat->init("calibScale", "Suggested analyticScale, x1000");
+            modelStats->append(scaleStat);
+        }
+        memStats->append(modelStats);
+    }
+
+    if (pagePolicy == ADAPTIVE) {
+        AggregateStat* pageStats = new AggregateStat();
+        pageStats->init("pagePolicy", "Adaptive page policy decisions");
+        profKeptOpen.init("keptOpen", "Rows left open on a predicted hit"); pageStats->append(&profKeptOpen);
+        profPredClosed.init("predClosed", "Rows precharged on a predicted miss"); pageStats->append(&profPredClosed);
+        profTimeoutPre.init("timeoutPre", "Open rows precharged after the page timeout"); pageStats->append(&profTimeoutPre);
+        profRowHitLimitUp.init("rhlUp", "Epochs that raised rowHitLimit"); pageStats->append(&profRowHitLimitUp);
+        profRowHitLimitDown.init("rhlDown", "Epochs that lowered rowHitLimit"); pageStats->append(&profRowHitLimitDown);
+        auto rhl = [this]() { return (uint64_t)rowHitLimit; };
+        auto rhlStat = makeLambdaStat(rhl);
+        rhlStat->init("rowHitLimit", "Current rowHitLimit");
+        pageStats->append(rhlStat);
+        memStats->append(pageStats);
+    }
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); 
 	// XXX //memStats->append(&latencyHist);
+
+    AggregateStat* energyStats = new AggregateStat();
+    energyStats->init("energy", "Energy stats (IDD-based)");
+    profActs.init("act", "ACT-PRE pairs"); energyStats->append(&profActs);
+    profRefreshes.init("ref", "Rank refreshes (excluding self-refresh)"); energyStats->append(&profRefreshes);
+    profRdBurstCycles.init("rdBurstCycles", "Data bus cycles of read bursts"); energyStats->append(&profRdBurstCycles);
+    profWrBurstCycles.init("wrBurstCycles", "Data bus cycles of write bursts"); energyStats->append(&profWrBurstCycles);
+    profActStbyCycles.init("actStbyCycles", "Rank-cycles in active standby"); energyStats->append(&profActStbyCycles);
+    profPreStbyCycles.init("preStbyCycles", "Rank-cycles in precharge standby"); energyStats->append(&profPreStbyCycles);
+    profActPdnCycles.init("actPdnCycles", "Rank-cycles in active power-down"); energyStats->append(&profActPdnCycles);
+    profPrePdnCycles.init("prePdnCycles", "Rank-cycles in precharge power-down"); energyStats->append(&profPrePdnCycles);
+    profSrefCycles.init("srefCycles", "Rank-cycles in self-refresh"); energyStats->append(&profSrefCycles);
+    profPdnExits.init("pdnExits", "Power-down exits"); energyStats->append(&profPdnExits);
+    profSrefExits.init("srefExits", "Self-refresh exits"); energyStats->append(&profSrefExits);
+
+    // Energies in nJ, following the Micron power calculator: ACT/PRE, bursts and refreshes are charged on
+    // top of active standby, which is in turn accounted for as background energy
+    auto actPreEnergy = [this]() {
+        uint32_t tRC = tRAS + tRP;
+        return (uint64_t)(profActs.get() * (energy(tRC, IDD0) - energy(tRAS, IDD3N) - energy(tRP, IDD2N)));
+    };
+    auto rdEnergy = [this]() { return (uint64_t)energy(profRdBurstCycles.get(), IDD4R - IDD3N); };
+    auto wrEnergy = [this]() { return (uint64_t)energy(profWrBurstCycles.get(), IDD4W - IDD3N); };
+    auto refEnergy = [this]() { return (uint64_t)(profRefreshes.get() * energy(tRFC, IDD5 - IDD3N)); };
+    auto bgEnergy = [this]() {
+        return (uint64_t)(energy(profActStbyCycles.get(), IDD3N) + energy(profPreStbyCycles.get(), IDD2N) +
+                energy(profActPdnCycles.get(), IDD3P) + energy(profPrePdnCycles.get(), IDD2P) +
+                energy(profSrefCycles.get(), IDD6));
+    };
+    auto totEnergy = [=]() { return actPreEnergy() + rdEnergy() + wrEnergy() + refEnergy() + bgEnergy(); };
+    // Average power over the simulated time, in mW (nJ/ns = W)
+    auto avgPower = [=]() {
+        double simNs = zinfo->globPhaseCycles*1000.0/zinfo->freqMHz;
+        return (uint64_t)(simNs? totEnergy()*1e3/simNs : 0);
+    };
+
+    auto actPreStat = makeLambdaStat(actPreEnergy); actPreStat->init("actPreEnergy", "ACT/PRE energy (nJ)"); energyStats->append(actPreStat);
+    auto rdStat = makeLambdaStat(rdEnergy); rdStat->init("rdEnergy", "Read burst energy (nJ)"); energyStats->append(rdStat);
+    auto wrStat = makeLambdaStat(wrEnergy); wrStat->init("wrEnergy", "Write burst energy (nJ)"); energyStats->append(wrStat);
+    auto refStat = makeLambdaStat(refEnergy); refStat->init("refEnergy", "Refresh energy (nJ)"); energyStats->append(refStat);
+    auto bgStat = makeLambdaStat(bgEnergy); bgStat->init("bgEnergy", "Background (standby, power-down, self-refresh) energy (nJ)"); energyStats->append(bgStat);
+    auto totStat = makeLambdaStat(totEnergy); totStat->init("totEnergy", "Total energy (nJ)"); energyStats->append(totStat);
+    auto powerStat = makeLambdaStat(avgPower); powerStat->init("avgPower", "Average power (mW)"); energyStats->append(powerStat);
+    memStats->append(energyStats);
+
     parentStat->append(memStats);
 }
 
 /* Bound phase interface */
-// data_size is the number of bursts
+// data_size is the number of bursts; in this model, each burst holds the data bus for one memCycle (see trySchedule)
 uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
     switch (req.type) {
         case PUTS:
@@ -269,18 +508,56 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
         bool isWrite = (req.type == PUTX);
 		// TODO If length > 1 cacheline, add 4 cycle for each cacheline
         uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency) + memToSysCycle(data_size - 1);
+        if (analytic || analyticCalibrate) {
+            uint64_t modelCycle = respCycle + modelAccess(req.lineAddr, isWrite, data_size);
+            if (!isWrite) {
+                profModelRdLat.atomicInc(modelCycle - req.cycle);
+                profModelBaseRdLat.atomicInc(respCycle - req.cycle);
+            }
+            if (analytic) {
+                // No weave events, so account for the request here
+                if (isWrite) {
+                    profWrites.atomicInc();
+                    profTotalWrLat.atomicInc(modelCycle - req.cycle);
+                } else {
+                    profReads.atomicInc();
+                    profTotalRdLat.atomicInc(modelCycle - req.cycle);
+                }
+                return modelCycle;
+            }
+        }
         if (zinfo->eventRecorders[req.srcId]) {
 			// accessing multiple lines is modeled as multiple requests.
 			// All the requests can be processed in parallel.
 			//  
-            DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
+            EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+            if (compactChains && type == 1) {
+                // Fold into the record's end event if it is an open request chain of ours
+                // (only DDRMemory marks composite tails, so the cast is safe)
+                DDRMemoryAccEvent* tail = static_cast<DDRMemoryAccEvent*>(evRec->getCompositeTail());
+                if (tail && tail->getMem() == this && tail->canAppend(isWrite, maxChainOps)) {
+                    TimingRecord tr = evRec->popRecord();
+                    assert(tr.endEvent == tail);
+                    tail->appendRequest(req.lineAddr, data_size, tr.reqCycle, maxChainOps, evRec);
+                    tr.type = req.type;
+                    evRec->pushRecord(tr);
+                    evRec->setCompositeTail(tail);
+                    profChainOps.atomicInc();
+                    return respCycle;
+                }
+            }
+
+            DDRMemoryAccEvent* memEv = new (evRec) DDRMemoryAccEvent(this,
                     isWrite, req.lineAddr, data_size, domain, preDelay, isWrite? postDelayWr : postDelayRd);
+			// A chain may start at a component that records no events (e.g., an analytic channel)
+			if (type != 0 && !evRec->hasRecord()) type = 0;
 			if (type == 0) // default. The only record. 
             {
             	memEv->setMinStartCycle(req.cycle);
 				TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
 				assert(!zinfo->eventRecorders[req.srcId]->hasRecord());
            	 	zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+                if (compactChains) evRec->setCompositeTail(memEv);
 			} else if (type == 1) { // append the current event to the end of the previous one
            	 	TimingRecord tr = zinfo->eventRecorders[req.srcId]->popRecord();
             	memEv->setMinStartCycle(tr.reqCycle);
@@ -291,6 +568,7 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 				tr.type = req.type;
 				tr.endEvent = memEv;
            	 	zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+                if (compactChains) evRec->setCompositeTail(memEv);
 			} else if (type == 2) { 
 				// append the current event to the end of the previous one
 				// but the current event is not on the critical path
@@ -308,6 +586,69 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
     }
 }
 
+/* Analytic model. Each request pays its row-buffer penalty, predicted by
+ * tracking the open row of each bank in access order, plus M/D/1 queueing
+ * delays at its bank and at the data bus, whose utilizations are measured
+ * over the previous phases (smoothed as in MD1Memory). Unlike MD1Memory, the
+ * load that banks see depends on the row hit rate. The modeled delays are
+ * multiplied by analyticScale, which can be calibrated with calibration mode.
+ */
+uint64_t DDRMemory::modelAccess(Address lineAddr, bool isWrite, uint32_t data_size) {
+    if (zinfo->globPhaseCycles > analyticLastCycle) {
+        futex_lock(&analyticLock);
+        if (zinfo->globPhaseCycles > analyticLastCycle) updateModel();  // recheck, someone may have updated already
+        futex_unlock(&analyticLock);
+    }
+
+    AddrLoc loc = mapLineAddr(lineAddr);
+    uint64_t& openRow = predOpenRow[loc.rank*banksPerRank + loc.bank];  // racy, but only a predictor
+    uint32_t rowDelay;
+    if (openRow == loc.row && pagePolicy != CLOSED) {
+        rowDelay = 0;
+        (isWrite? profModelWrHits : profModelRdHits).atomicInc();
+        // When calibrating, weave events count the actual row hits
+        if (analytic) (isWrite? profWriteHits : profReadHits).atomicInc();
+    } else {
+        rowDelay = (openRow == -1ul || pagePolicy == CLOSED)? tRCD : tRP + tRCD;
+    }
+    openRow = loc.row;
+
+    __sync_fetch_and_add(&phaseReqs, 1);
+    __sync_fetch_and_add(&phaseBusCycles, data_size);
+    __sync_fetch_and_add(&phaseBankCycles, rowDelay + data_size);
+
+    if (isWrite) return memToSysCycle((uint64_t)(analyticScale*modelQueueDelay)) - memToSysCycle(0);  // posted, only queueing
+    return memToSysCycle((uint64_t)(analyticScale*(rowDelay + modelQueueDelay))) - memToSysCycle(0);
+}
+
+void DDRMemory::updateModel() {
+    uint64_t cycles = sysToMemCycle(zinfo->globPhaseCycles) - sysToMemCycle(analyticLastCycle);
+    if (cycles < 1000) return;  // skip short intervals
+
+    uint64_t reqs = phaseReqs;
+    uint64_t banks = ranksPerChannel*banksPerRank;
+    double phaseBusUtil = ((double)phaseBusCycles)/cycles;
+    double phaseBankUtil = ((double)phaseBankCycles)/(cycles*banks);
+    busUtil = 0.5*phaseBusUtil + 0.5*busUtil;
+    bankUtil = 0.5*phaseBankUtil + 0.5*bankUtil;
+    if (reqs) {
+        busService = ((double)phaseBusCycles)/reqs;
+        bankService = ((double)phaseBankCycles)/reqs;
+    }
+
+    // M/D/1 (Pollaczek-Khinchine) waiting time, with loads clamped as in MD1Memory
+    auto md1Wait = [](double util, double service) {
+        util = std::min(util, 0.95);
+        return 0.5*service*util/(1.0 - util);
+    };
+    modelQueueDelay = (uint32_t)(md1Wait(busUtil, busService) + md1Wait(bankUtil, bankService));
+    profModelUpdates.inc();
+
+    phaseReqs = phaseBusCycles = phaseBankCycles = 0;
+    __sync_synchronize();
+    analyticLastCycle = zinfo->globPhaseCycles;
+}
+
 uint64_t
 DDRMemory::rd_dram_tag_latency(MemReq& req, uint32_t data_size)
 {
@@ -345,6 +686,8 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
     DEBUG("%ld: enqueue() addr 0x%lx wr %d", memCycle, ev->getAddr(), ev->isWrite());
 
+    if ((coalesceWindow || writeCombine) && tryMerge(ev, memCycle, sysCycle)) return;
+
     // Create request
     Request ovfReq;
     bool overflow = rdQueue.full() || wrQueue.full();
@@ -357,6 +700,8 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     req->write = ev->isWrite();
     req->arrivalCycle = memCycle;
     req->startSysCycle = sysCycle;
+    req->mergedWrites = 0;
+    req->mergedWrStartSum = 0;
 
     req->ev = ev;
     ev->hold();
@@ -391,6 +736,54 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     }
 }
 
+/* Coalescing stage: fold an incoming request into a pending, not yet issued
+ * command of the same bank queue. Same-line writes are combined (the pending
+ * write carries the new data), and same-row requests of the same type that
+ * arrive within coalesceWindow cycles of the pending one extend it into a
+ * multi-burst command. Merged reads are chained to the command's event and
+ * all get the command's response. Merged writes are acked right away, as
+ * queue() does for all writes. Either way, each merged request counts as a
+ * read or write in the stats when the command issues, with its latency
+ * measured from its own arrival.
+ */
+bool DDRMemory::tryMerge(DDRMemoryAccEvent* ev, uint64_t memCycle, uint64_t sysCycle) {
+    AddrLoc loc = mapLineAddr(ev->getAddr());
+    bool isWrite = ev->isWrite();
+    Bank& bank = banks[loc.rank][loc.bank];
+    InList<Request>& q = (deferredWrites && isWrite)? bank.wrReqs : bank.rdReqs;
+
+    for (Request* m = q.back(); m; m = m->prev) {
+        if (m->write != isWrite || m->loc.row != loc.row) continue;
+
+        bool combine = isWrite && writeCombine && m->addr == ev->getAddr();
+        bool coalesce = coalesceWindow && m->arrivalCycle + coalesceWindow >= memCycle &&
+            m->data_size + ev->getDataSize() <= maxCoalesceBursts;
+        if (!combine && !coalesce) continue;
+
+        if (isWrite) {
+            ev->respond(memToSysCycle(memCycle) + minWrLatency - preDelay - postDelayWr);
+            m->mergedWrites++;
+            m->mergedWrStartSum += sysCycle;
+        } else {
+            ev->hold();
+            ev->setMergeSysCycle(sysCycle);
+            ev->setCoalescedNext(m->ev->getCoalescedNext());
+            m->ev->setCoalescedNext(ev);
+        }
+
+        if (combine) {
+            m->data_size = std::max(m->data_size, ev->getDataSize());
+            profWrCombined.inc();
+        } else {
+            m->data_size += ev->getDataSize();
+            profCoalesced.inc();
+        }
+        DEBUG("%ld: merged 0x%lx into 0x%lx (%s), %d bursts", memCycle, ev->getAddr(), m->addr, combine? "WC" : "CO", m->data_size);
+        return true;
+    }
+    return false;
+}
+
 void DDRMemory::queue(Request* req, uint64_t memCycle) {
     // If it's a write, respond to it immediately
     if (req->write) {
@@ -399,7 +792,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 
         ev->release();
         uint64_t respCycle = memToSysCycle(memCycle) + minWrLatency;
-        ev->done(respCycle - preDelay - postDelayWr);
+        ev->respond(respCycle - preDelay - postDelayWr);
     }
 
     req->arrivalCycle = memCycle;  // if this comes from the overflow queue, update
@@ -449,7 +842,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 
     // No matches...
     if (!m) {
-        if (bank.open && req->loc.row == bank.openRow && bank.curRowHits < rowHitLimit && q.empty()) {
+        if (rowOpenAt(bank, memCycle) && req->loc.row == bank.openRow && bank.curRowHits < rowHitLimit && q.empty()) {
             // ... but row is open (& bank queue empty), bypass everyone
             /* NOTE: If the bank queue is not empty, don't go before the
              * current request. We assume that the request could have issued
@@ -519,13 +912,14 @@ void DDRMemory::recycleEvent(SchedEvent* ev) {
 uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
     const Bank& bank = banks[r.loc.rank][r.loc.bank];
     uint64_t minCmdCycle = std::max(r.arrivalCycle, bank.lastCmdCycle + 1);
-    if (r.loc.row == bank.openRow && bank.open) {
+    bool open = rowOpenAt(bank, minCmdCycle);
+    if (r.loc.row == bank.openRow && open) {
         // Row buffer hit
     } else {
         // Either row closed, or row buffer miss
         uint64_t preCycle;
-        if (!bank.open) {
-            preCycle = bank.minPreCycle;
+        if (!open) {
+            preCycle = bank.open? std::max(bank.minPreCycle, bank.autoPreCycle) : bank.minPreCycle;
         } else {
             assert(r.loc.row != bank.openRow);
             preCycle = std::max(r.arrivalCycle, bank.minPreCycle);
@@ -600,10 +994,13 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     // without column access or data bus constraints
     uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
     if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
+    if (pagePolicy == ADAPTIVE) closeTimedOutRow(bank, r->loc.rank, minCmdCycle);
+    bool wouldHit = (r->loc.row == bank.openRow);  // if the row had been left open
     bool rowHit = false;
     if (r->loc.row == bank.openRow && bank.open) {
         // Row buffer hit
         rowHit = true;
+        minCmdCycle += wakeRank(r->loc.rank, minCmdCycle);  // the rank may be in active power-down
     } else {
         // Either row closed, or row buffer miss
         uint64_t preCycle;
@@ -613,14 +1010,21 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         } else {
             assert(r->loc.row != bank.openRow);
             preCycle = std::max(r->arrivalCycle, bank.minPreCycle);
+            // The PRE is the first command the rank sees, so it pays the power-down exit; the rank stays up after it
+            preCycle += wakeRank(r->loc.rank, preCycle);
+            chargeBusy(r->loc.rank, preCycle);
         }
 
         uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
+        actCycle += wakeRank(r->loc.rank, actCycle);
 
         // Record ACT
+        if (!bank.open) rankPowers[r->loc.rank].openBanks++;
+        profActs.inc();
         bank.open = true;
         bank.openRow = r->loc.row;
+        bank.autoPreCycle = -1ul;
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
         rankActWindows[r->loc.rank].addActivation(actCycle);
         bank.lastActCycle = actCycle;
@@ -633,13 +1037,33 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 	// To support accessing granularity greater than a cacheline. 
     //minRespCycle = cmdCycle + tCL + tBL;
     //minRespCycle = cmdCycle + tCL + tBL * r->data_size;
-    minRespCycle = cmdCycle + tCL + r->data_size;
+    uint64_t busCycles = r->data_size;  // data bus cycles of this command's bursts, one per burst
+    minRespCycle = cmdCycle + tCL + busCycles;
     lastCmdWasWrite = r->write;
 
     // Record PRE
     // if closed-page, close (auto-precharge) if no more row buffer hits
     // if open-page, minPreCycle is used for row buffer misses
-    if (closedPage && !(r->next && r->next->rowHitSeq != 0)) bank.open = false;
+    // if adaptive, close or leave open (till the page timeout) depending on the bank's predictor
+    bool moreRowHits = r->next && r->next->rowHitSeq != 0;
+    bool closeRow = !moreRowHits && pagePolicy == CLOSED;
+    bank.autoPreCycle = -1ul;
+    if (pagePolicy == ADAPTIVE) {
+        updatePagePolicy(bank, wouldHit);
+        if (!moreRowHits) {
+            if (bank.hitPred >= 2) {
+                bank.autoPreCycle = minRespCycle + pageTimeout;
+                profKeptOpen.inc();
+            } else {
+                closeRow = true;
+                profPredClosed.inc();
+            }
+        }
+    }
+    if (closeRow) {
+        bank.open = false;
+        rankPowers[r->loc.rank].openBanks--;
+    }
     bank.minPreCycle = std::max(
             bank.minPreCycle,  // for mixed read and write commands, minPreCycle may not be monotonic without this
             std::max(bank.lastActCycle + tRAS,  // RAS constraint
@@ -650,6 +1074,8 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     assert(bank.lastCmdCycle < cmdCycle);
     bank.lastCmdCycle = cmdCycle;
     bank.curRowHits = r->rowHitSeq;
+    chargeBusy(r->loc.rank, minRespCycle);
+    (r->write? profWrBurstCycles : profRdBurstCycles).inc(busCycles);
 
     // Issue response
     if (r->ev) {
@@ -659,11 +1085,24 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
         assert(doneSysCycle >= sysCycle);
 
-        ev->release();
-        ev->done(doneSysCycle - preDelay - postDelayRd);
+        // Respond to this and all coalesced reads (respond() frees or requeues events, so get next first).
+        // Each one is a read in the stats, with its latency measured from its own arrival
+        uint64_t startSysCycle = r->startSysCycle;
+        while (ev) {
+            auto next = ev->getCoalescedNext();
+            uint32_t scDelay = doneSysCycle - startSysCycle;
+            profReads.inc();
+            profTotalRdLat.inc(scDelay);
+            if (rowHit) profReadHits.inc();
+            uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
+            latencyHist.inc(bucket, 1);
+
+            ev->release();
+            ev->respond(doneSysCycle - preDelay - postDelayRd);
+            ev = next;
+            if (ev) startSysCycle = ev->getMergeSysCycle();
+        }
 
-        uint32_t scDelay = doneSysCycle - r->startSysCycle;
-        profReads.inc();
 		//if (tBL == 4)
 	    //    bytesReads.inc(64 * r->data_size);
 		//else if (tBL == 1)
@@ -671,13 +1110,10 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 		//else 
 		//	assert(false);
         bytesReads.inc(16 * r->data_size);
-        profTotalRdLat.inc(scDelay);
-        if (rowHit) profReadHits.inc();
-        uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
-        latencyHist.inc(bucket, 1);
     } else {
-        uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
-        profWrites.inc();
+        uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
+        uint32_t scDelay = doneSysCycle - r->startSysCycle;
+        profWrites.inc(1 + r->mergedWrites);
         bytesWrites.inc(16 * r->data_size);
 		//if (tBL == 4)
         //	bytesWrites.inc(64 * r->data_size);
@@ -686,8 +1122,8 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 		//else 
 		//	assert(false);
 
-        profTotalWrLat.inc(scDelay);
-        if (rowHit) profWriteHits.inc();
+        profTotalWrLat.inc(scDelay + r->mergedWrites*doneSysCycle - r->mergedWrStartSum);
+        if (rowHit) profWriteHits.inc(1 + r->mergedWrites);
     }
 
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
@@ -709,7 +1145,21 @@ void DDRMemory::refresh(uint64_t sysCycle) {
     }
     assert(minRefreshCycle >= memCycle);
 
-    uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
+    // Ranks in self-refresh refresh themselves (IDD6 covers it); powered-down ranks exit power-down (tXP) first
+    assert(ranksPerChannel <= 64);
+    uint64_t srefRanks = 0;  // bitmap
+    uint64_t refreshStartCycle = minRefreshCycle;
+    for (uint32_t r = 0; r < ranksPerChannel; r++) {
+        PowerState state = chargeIdle(r, minRefreshCycle);
+        if (state == SELF_REFRESH) {
+            srefRanks |= 1ul << r;
+        } else if (state == POWER_DOWN) {
+            profPdnExits.inc();
+            refreshStartCycle = std::max(refreshStartCycle, minRefreshCycle + tXP);
+        }
+    }
+
+    uint64_t refreshDoneCycle = refreshStartCycle + tRFC;
     assert(tRFC >= tRP);
     for (auto& rankBanks : banks) {
         for (auto& bank : rankBanks) {
@@ -720,7 +1170,126 @@ void DDRMemory::refresh(uint64_t sysCycle) {
         }
     }
 
-    DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
+    // Other ranks are busy refreshing till refreshDoneCycle
+    for (uint32_t r = 0; r < ranksPerChannel; r++) {
+        if (srefRanks & (1ul << r)) continue;
+        rankPowers[r].openBanks = 0;
+        chargeBusy(r, refreshDoneCycle);
+        profRefreshes.inc();
+    }
+
+    DEBUG("Refresh %ld start %ld done %ld", memCycle, refreshStartCycle, refreshDoneCycle);
+}
+
+/* Adaptive page policy
+ *
+ * Each bank has a 2-bit saturating counter that tracks whether accesses would
+ * hit the bank's last row. When no row hits are queued, banks predicted to hit
+ * keep their row open for pageTimeout cycles, and the rest precharge right
+ * away. Timeouts are applied lazily, when the bank is next used. Also, every
+ * rowHitEpoch commands, we raise rowHitLimit when most commands are row hits
+ * (e.g., page migrations) to keep streaming through the open row, and lower
+ * it when few are (random demand traffic) to improve fairness.
+ */
+
+void DDRMemory::closeTimedOutRow(Bank& bank, uint32_t rank, uint64_t cycle) {
+    if (bank.open && bank.autoPreCycle <= cycle) {
+        bank.open = false;
+        bank.minPreCycle = std::max(bank.minPreCycle, bank.autoPreCycle);  // PRE issued at the timeout
+        bank.autoPreCycle = -1ul;
+        rankPowers[rank].openBanks--;
+        profTimeoutPre.inc();
+    }
+}
+
+void DDRMemory::updatePagePolicy(Bank& bank, bool wouldHit) {
+    if (wouldHit) {
+        if (bank.hitPred < 3) bank.hitPred++;
+    } else {
+        if (bank.hitPred > 0) bank.hitPred--;
+    }
+
+    epochCmds++;
+    if (wouldHit) epochRowHits++;
+    if (epochCmds == rowHitEpoch) {
+        if (epochRowHits > 3*epochCmds/4 && rowHitLimit < maxRowHitLimit) {
+            rowHitLimit = std::min((uint64_t)2*rowHitLimit, (uint64_t)maxRowHitLimit);
+            profRowHitLimitUp.inc();
+        } else if (epochRowHits < epochCmds/4 && rowHitLimit > 1) {
+            rowHitLimit /= 2;
+            profRowHitLimitDown.inc();
+        }
+        DEBUG("%s: epoch row hits %d/%d, rowHitLimit %d", name.c_str(), epochRowHits, epochCmds, rowHitLimit);
+        epochCmds = epochRowHits = 0;
+    }
+}
+
+/* Energy accounting
+ *
+ * Each rank is either busy (commands in flight, charged as active standby) or
+ * idle since idleStartCycle. Idle ranks stay in standby for powerDownThreshold
+ * cycles, then power down (active or precharge power-down, depending on
+ * whether they have open rows), and precharged ranks enter self-refresh after
+ * selfRefreshThreshold cycles. We charge background cycles lazily, when the
+ * rank is woken up by a command or a refresh, so this costs a few ops per
+ * command.
+ */
+
+DDRMemory::PowerState DDRMemory::chargeIdle(uint32_t rank, uint64_t cycle) {
+    RankPower& rp = rankPowers[rank];
+    if (cycle <= rp.accountedCycle) return STANDBY;  // still busy
+
+    uint64_t srefCycle = (selfRefreshThreshold && !rp.openBanks)? rp.idleStartCycle + selfRefreshThreshold : -1ul;
+    uint64_t pdnCycle = powerDownThreshold? rp.idleStartCycle + powerDownThreshold : -1ul;
+    pdnCycle = std::min(pdnCycle, srefCycle);
+
+    // Cycles of [accountedCycle, cycle) that fall in [lo, hi)
+    auto span = [&](uint64_t lo, uint64_t hi) {
+        lo = std::max(lo, rp.accountedCycle);
+        hi = std::min(hi, cycle);
+        return (hi > lo)? hi - lo : 0;
+    };
+    uint64_t stbyCycles = span(0, pdnCycle);
+    uint64_t pdnCycles = span(pdnCycle, srefCycle);
+    uint64_t srefCycles = span(srefCycle, -1ul);
+    if (rp.openBanks) {
+        profActStbyCycles.inc(stbyCycles);
+        profActPdnCycles.inc(pdnCycles);
+    } else {
+        profPreStbyCycles.inc(stbyCycles);
+        profPrePdnCycles.inc(pdnCycles);
+    }
+    profSrefCycles.inc(srefCycles);
+    rp.accountedCycle = cycle;
+
+    return (cycle > srefCycle)? SELF_REFRESH : (cycle > pdnCycle)? POWER_DOWN : STANDBY;
+}
+
+// Returns the exit latency the rank incurs if its next command is at cycle
+uint32_t DDRMemory::wakeRank(uint32_t rank, uint64_t cycle) {
+    switch (chargeIdle(rank, cycle)) {
+        case SELF_REFRESH:
+            profSrefExits.inc();
+            return tXS;
+        case POWER_DOWN:
+            profPdnExits.inc();
+            return tXP;
+        default:
+            return 0;
+    }
+}
+
+void DDRMemory::chargeBusy(uint32_t rank, uint64_t endCycle) {
+    RankPower& rp = rankPowers[rank];
+    if (endCycle > rp.accountedCycle) {
+        profActStbyCycles.inc(endCycle - rp.accountedCycle);
+        rp.accountedCycle = endCycle;
+    }
+    rp.idleStartCycle = std::max(rp.idleStartCycle, endCycle);
+}
+
+double DDRMemory::energy(uint64_t cycles, double current) const {
+    return cycles * tCK * current * VDD * devicesPerRank * 1e-3;  // mA * V * ns = pJ
 }
 
 
@@ -728,7 +1297,9 @@ void DDRMemory::refresh(uint64_t sysCycle) {
 
 void DDRMemory::initTech(const char* techName, double time_scale) {
     std::string tech(techName);
-    double tCK;
+    tCK = 0.0;
+    tXP = 0;
+    IDD6 = 0.0;
 
     // tBL's below are for 64-byte lines; we adjust as needed
 
@@ -748,6 +1319,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 8 / time_scale);
         tRFC = uint32_t( 130 / time_scale);
         tREFI = uint32_t(1950 / time_scale);
+        tXP = uint32_t( 4 / time_scale);
+        // Per pseudo-channel die slice
+        VDD = 1.2;
+        IDD0 = 65; IDD2P = 28; IDD2N = 40; IDD3P = 40; IDD3N = 55;
+        IDD4R = 390; IDD4W = 330; IDD5 = 250; IDD6 = 31;
+        devicesPerRank = 1;
     }else if(tech == "DDR4-3200-CL22"){
         tCK = 0.63;
         // tBL = ;
@@ -763,6 +1340,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 24 / time_scale);
         tRFC = uint32_t( 560 / time_scale);
         tREFI = uint32_t(12480 / time_scale);
+        tXP = uint32_t( 10 / time_scale);
+        // 8Gb x8 devices
+        VDD = 1.2;
+        IDD0 = 60; IDD2P = 25; IDD2N = 37; IDD3P = 38; IDD3N = 52;
+        IDD4R = 168; IDD4W = 150; IDD5 = 250; IDD6 = 30;
+        devicesPerRank = 8;
     }
     else if(tech == "DDR4-3200-CL22-2"){
         tCK = 0.63*2;
@@ -778,6 +1361,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 24 / time_scale);
         tRFC = uint32_t( 560 / time_scale);
         tREFI = uint32_t(12480 / time_scale);
+        tXP = uint32_t( 10 / time_scale);
+        // 8Gb x8 devices
+        VDD = 1.2;
+        IDD0 = 60; IDD2P = 25; IDD2N = 37; IDD3P = 38; IDD3N = 52;
+        IDD4R = 168; IDD4W = 150; IDD5 = 250; IDD6 = 30;
+        devicesPerRank = 8;
     }
     else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
@@ -794,6 +1383,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 10 / time_scale);
         tRFC = uint32_t( 74 / time_scale);
         tREFI = uint32_t( 5200 / time_scale);
+        tXP = uint32_t( 4 / time_scale);
+        // 2Gb x4 devices, same source
+        VDD = 1.5;
+        IDD0 = 100; IDD2P = 10; IDD2N = 70; IDD3P = 60; IDD3N = 90;
+        IDD4R = 230; IDD4W = 255; IDD5 = 305; IDD6 = 9;
+        devicesPerRank = 16;
     } else if (tech == "DDR3-1333-CL10-2") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
         tCK = 1.5 / 2;  // ns; all other in mem cycles
@@ -809,6 +1404,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = uint32_t( 8 / time_scale);
         tRFC = uint32_t( 60 / time_scale);
         tREFI = uint32_t( 4000 / time_scale);
+        tXP = uint32_t( 4 / time_scale);
+        // 2Gb x4 devices, same source
+        VDD = 1.5;
+        IDD0 = 100; IDD2P = 10; IDD2N = 70; IDD3P = 60; IDD3N = 90;
+        IDD4R = 230; IDD4W = 255; IDD5 = 305; IDD6 = 9;
+        devicesPerRank = 16;
     } else if (tech == "DDR3-1066-CL7") {
         // from DDR3_micron_16M_8B_x4_sg187.ini
         // see http://download.micron.com/pdf/datasheets/dram/ddr3/1Gb_DDR3_SDRAM.pdf, cl7 variant, copied from it; tRRD is widely different, others match
@@ -825,6 +1426,12 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = 7;
         tRFC = 59;
         tREFI = 4160;
+        tXP = 4;
+        // 1Gb x4 devices
+        VDD = 1.5;
+        IDD0 = 90; IDD2P = 12; IDD2N = 65; IDD3P = 40; IDD3N = 70;
+        IDD4R = 190; IDD4W = 200; IDD5 = 230; IDD6 = 8;
+        devicesPerRank = 16;
     } else if (tech == "DDR3-1066-CL8") {
         // from DDR3_micron_16M_8B_x4_sg187.ini
         tCK = 1.875;
@@ -840,13 +1447,23 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = 8;
         tRFC = 59;
         tREFI = 4160;
+        tXP = 4;
+        // 1Gb x4 devices
+        VDD = 1.5;
+        IDD0 = 90; IDD2P = 12; IDD2N = 65; IDD3P = 40; IDD3N = 70;
+        IDD4R = 190; IDD4W = 200; IDD5 = 230; IDD6 = 8;
+        devicesPerRank = 16;
     } else {
         panic("Unknown technology %s, you'll need to define it", techName);
     }
 
     // Check all params were set
     assert(tCK > 0.0);
-    assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI);
+    assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI && tXP);
+    assert(IDD6 > 0.0);
+
+    // tXS = tRFC + 10ns on all the above
+    tXS = tRFC + (uint32_t)std::ceil(10.0 / tCK);
 
     if (isPow2(lineSize) && lineSize >= 64) {
         tBL = lineSize*tBL/64;
@@ -155,6 +155,10 @@
              // Cycle accounting
              uint64_t arrivalCycle;  // in memCycles
              uint64_t startSysCycle;  // in sysCycles
+
+             // Writes merged into this one (see tryMerge()), counted when it is issued
+             uint32_t mergedWrites;
+             uint64_t mergedWrStartSum;  // sum of their arrival sysCycles
  
              // Corresponding event to send a response to
              // Writes get a response immediately, so this is nullptr for them
@@ -171,10 +175,23 @@
              uint64_t lastCmdCycle;  // RD/WR command, used for refreshes only
  
              uint64_t curRowHits;    // row hits on the currently opened row
+
+             // Adaptive page policy
+             uint64_t autoPreCycle;  // if open, cycle at which the idle row is precharged (-1 if never)
+             uint32_t hitPred;       // 2-bit counter, predicts whether the next access hits the last row
  
              InList<Request> rdReqs;
              InList<Request> wrReqs;
          };
+
+         // Background power state of a rank, used for energy accounting and power-down exit latencies
+         enum PowerState { STANDBY, POWER_DOWN, SELF_REFRESH };
+
+         struct RankPower {
+             uint64_t idleStartCycle;  // cycle the rank went idle (last command or refresh done)
+             uint64_t accountedCycle;  // background energy has been charged up to this cycle
+             uint32_t openBanks;       // selects active vs precharge standby/power-down
+         };
  
          // Global timing constraints
          /* We wake up at minSchedCycle, issue one or more requests, and
@@ -191,9 +208,17 @@
          const uint32_t lineSize, ranksPerChannel, banksPerRank;
          const uint32_t controllerSysLatency;  // in sysCycles
          const uint32_t queueDepth;
-         const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
+         uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point; tuned per epoch if ADAPTIVE
          const bool deferredWrites;
-         const bool closedPage;
+
+         // Row buffer management: CLOSED precharges once no row hits are queued, OPEN leaves rows open,
+         // and ADAPTIVE keeps rows open for up to pageTimeout cycles when the bank's predictor expects a hit
+         enum PagePolicy { CLOSED, OPEN, ADAPTIVE };
+         PagePolicy pagePolicy;
+         uint32_t pageTimeout;       // in memCycles
+         uint32_t rowHitEpoch;       // commands per rowHitLimit tuning epoch
+         uint32_t maxRowHitLimit;
+         uint32_t epochCmds, epochRowHits;
          const uint32_t domain;
  
          // DRAM timing parameters -- initialized in initTech()
@@ -210,6 +235,51 @@
          uint32_t tWR;    // end of WR burst to PRE
          uint32_t tRFC;   // Refresh to ACT (refresh leaves rows closed)
          uint32_t tREFI;  // Refresh interval
+         uint32_t tXP;    // Power-down exit to any command
+         uint32_t tXS;    // Self-refresh exit to any command
+
+         // DRAM current/voltage parameters -- initialized in initTech()
+         // Currents are per device, in mA; see the Micron DDR3/DDR4 power calculators
+         double tCK;      // in ns
+         double VDD;
+         double IDD0;     // ACT-PRE
+         double IDD2P;    // precharge power-down
+         double IDD2N;    // precharge standby
+         double IDD3P;    // active power-down
+         double IDD3N;    // active standby
+         double IDD4R;    // read burst
+         double IDD4W;    // write burst
+         double IDD5;     // refresh
+         double IDD6;     // self-refresh
+         uint32_t devicesPerRank;
+
+         // Coalescing stage (see tryMerge()); a 0 window disables same-row coalescing
+         uint32_t coalesceWindow;     // in memCycles
+         uint32_t maxCoalesceBursts;  // max data_size of a coalesced command
+         bool writeCombine;
+
+         // Fold type-1 (sequential) request chains into a single multi-op event
+         bool compactChains;
+         uint32_t maxChainOps;  // requests per multi-op event
+
+         // Analytic memory model: this channel's requests are timed in the bound phase
+         // by a queueing model fed with the previous phases' load, and produce no weave
+         // events. Cores and caches are unaffected; they still record and weave their
+         // own events. The model also runs (without affecting timing) in calibration
+         // mode, to compare it against the event-driven controller.
+         bool analytic, analyticCalibrate;
+         double analyticScale;  // multiplies the modeled row and queueing delays
+         lock_t analyticLock;
+         volatile uint64_t analyticLastCycle;  // sysCycle of the last model update
+         volatile uint64_t phaseReqs, phaseBusCycles, phaseBankCycles;  // load since the last update, in memCycles
+         double busUtil, bankUtil;  // smoothed utilization of the data bus and of the average bank
+         double busService, bankService;  // average occupancy per request, in memCycles
+         uint32_t modelQueueDelay;  // current queueing delay estimate, in memCycles
+         g_vector<uint64_t> predOpenRow;  // per rank*banksPerRank + bank; -1 if closed
+
+         // Power-down policy, in memCycles of rank idleness (0 disables the state)
+         uint32_t powerDownThreshold;
+         uint32_t selfRefreshThreshold;
  
          // Address mapping information
          uint32_t colShift, colMask;
@@ -226,6 +296,7 @@
  
          g_vector< g_vector<Bank> > banks; // indexed by rank, bank
          g_vector<ActWindow> rankActWindows;
+         g_vector<RankPower> rankPowers;
  
          // Event scheduling
          SchedEvent* nextSchedEvent;
@@ -234,14 +305,28 @@
  
          const g_string name;
  
-         // R/W stats
+         // R/W stats. Sharded ones are also updated from access() (analytic mode), i.e., by all simulation threads
          PAD();
-         Counter profReads, profWrites;
-         Counter bytesReads, bytesWrites;
-         Counter profTotalRdLat, profTotalWrLat;
+         ShardedCounter profReads, profWrites;
+         ShardedCounter bytesReads, bytesWrites;
+         ShardedCounter profTotalRdLat, profTotalWrLat;
          Counter profReadHits, profWriteHits;  // row buffer hits
+         Counter profCoalesced, profWrCombined;  // requests merged into pending commands
+         Counter profChainOps;  // requests folded into multi-op events
+         ShardedCounter profModelRdLat, profModelBaseRdLat;  // analytic model predictions
+         ShardedCounter profModelRdHits, profModelWrHits;
+         Counter profModelUpdates;
+         Counter profKeptOpen, profPredClosed, profTimeoutPre;  // adaptive page policy decisions
+         Counter profRowHitLimitUp, profRowHitLimitDown;
          VectorCounter latencyHist;
          static const uint32_t BINSIZE = 10, NUMBINS = 100;
+
+         // Energy stats; raw counts, energies are derived from them at dump time
+         Counter profActs, profRefreshes;
+         Counter profRdBurstCycles, profWrBurstCycles;
+         Counter profActStbyCycles, profPreStbyCycles;  // rank-cycles in each background state
+         Counter profActPdnCycles, profPrePdnCycles, profSrefCycles;
+         Counter profPdnExits, profSrefExits;
          PAD();
  
          //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
@@ -266,6 +351,21 @@
              uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
              uint32_t _domain, g_string& _name, uint32_t _tBL = 4, double time_scale = 1.0);
  
+         // Overrides the tech's device count and enables power-down/self-refresh (thresholds of 0 disable them)
+         void initPower(uint32_t _devicesPerRank, uint32_t _powerDownThreshold, uint32_t _selfRefreshThreshold);
+
+         // Overrides the closed/open page policy set at construction; policy is "closed", "open" or "adaptive"
+         void initPagePolicy(const char* policy, uint32_t _pageTimeout, uint32_t _rowHitEpoch, uint32_t _maxRowHitLimit);
+
+         // Enables request coalescing and/or write-combining (disabled by default)
+         void initCoalescing(uint32_t _coalesceWindow, uint32_t _maxCoalesceBursts, bool _writeCombine);
+
+         // Enables chain compaction (disabled by default); timing is the same as with one event per request
+         void initChainCompaction(bool enable, uint32_t maxOps);
+
+         // Switches to the analytic model (no weave events), or runs it alongside the event-driven model to calibrate scale
+         void initAnalytic(bool enable, bool calibrate, double scale);
+
          void initStats(AggregateStat* parentStat);
          const char* getName() {return name.c_str();}
  
@@ -292,10 +392,26 @@
      private:
          AddrLoc mapLineAddr(Address lineAddr);
  
+         bool tryMerge(DDRMemoryAccEvent* ev, uint64_t memCycle, uint64_t sysCycle);
          void queue(Request* req, uint64_t memCycle);
  
          inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
          uint64_t findMinCmdCycle(const Request& r) const;
+
+         // Adaptive page policy
+         inline bool rowOpenAt(const Bank& bank, uint64_t cycle) const { return bank.open && cycle < bank.autoPreCycle; }
+         void closeTimedOutRow(Bank& bank, uint32_t rank, uint64_t cycle);
+         void updatePagePolicy(Bank& bank, bool wouldHit);
+
+         // Analytic model; returns the modeled latency beyond the bound-phase minimum, in sysCycles
+         uint64_t modelAccess(Address lineAddr, bool isWrite, uint32_t data_size);
+         void updateModel();
+
+         // Energy accounting
+         PowerState chargeIdle(uint32_t rank, uint64_t cycle);
+         uint32_t wakeRank(uint32_t rank, uint64_t cycle);
+         void chargeBusy(uint32_t rank, uint64_t endCycle);
+         double energy(uint64_t cycles, double current) const;  // in nJ, for all devices of a rank
  
          void initTech(const char* tech, double time_scale);
  };
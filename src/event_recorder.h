@@ -55,7 +55,9 @@ typedef g_vector<CrossingEvent*> CrossingStack;
 class EventRecorder : public GlobAlloc {
     private:
         slab::SlabAlloc slabAlloc;
+        slab::SlabAlloc memSlabAlloc;  // memory-side access events, see allocMem()
         TimingRecord tr;
+        TimingEvent* compositeTail;  // the record's endEvent, if it can absorb further sequential ops (see MultiOpEvent)
         CrossingStack crossingStack;
         uint32_t srcId;
 
@@ -65,7 +67,7 @@ class EventRecorder : public GlobAlloc {
         PAD();
 
     public:
-        EventRecorder() {
+        EventRecorder() : compositeTail(nullptr) {
             tr.clear();
         }
 
@@ -80,11 +82,30 @@ class EventRecorder : public GlobAlloc {
             return slabAlloc.alloc(sz);
         }
 
+        // Typed pool for short-lived memory controller events (e.g., DDR
+        // accesses). These are all done by the end of the weave phase that
+        // follows their allocation, so keeping them apart from core events,
+        // which may live across phases, lets their slabs be recycled whole
+        // every phase instead of being pinned by a single long-lived event.
+        void* allocMem(size_t sz) {
+            return memSlabAlloc.alloc(sz);
+        }
+
+        // Called at phase end, when no thread allocates from this recorder
+        void recycle() {
+            slabAlloc.recycle();
+            memSlabAlloc.recycle();
+        }
+
+        const slab::SlabAlloc& getSlabAlloc() const { return slabAlloc; }
+        const slab::SlabAlloc& getMemSlabAlloc() const { return memSlabAlloc; }
+
         //Event recording interface
 
         void pushRecord(const TimingRecord& rec) {
             assert(!tr.isValid());
             tr = rec;
+            compositeTail = nullptr;
             assert(tr.isValid());
         }
 
@@ -92,9 +113,21 @@ class EventRecorder : public GlobAlloc {
         inline TimingRecord popRecord() __attribute__((always_inline)) {
             TimingRecord rec = tr;
             tr.clear();
+            compositeTail = nullptr;
             return rec;
         }
 
+        // Marks the current record's endEvent as extensible by the component
+        // that created it. Any other push/pop of the record clears the mark.
+        void setCompositeTail(TimingEvent* ev) {
+            assert(tr.isValid() && tr.endEvent == ev);
+            compositeTail = ev;
+        }
+
+        inline TimingEvent* getCompositeTail() const {
+            return compositeTail;
+        }
+
         inline size_t hasRecord() const {
             return tr.isValid();
         }
@@ -0,0 +1,41 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HDF5_LOCK_H_
+#define HDF5_LOCK_H_
+
+#include "locks.h"
+
+/* The HDF5 library we link against is not built thread-safe, so code that
+ * calls it outside of initialization serializes on this per-process lock
+ * (e.g., AccessTraceReader decodes chunks on a helper thread while stats are
+ * dumped to HDF5 files). Being inline, all translation units share the lock.
+ */
+inline lock_t* hdf5Lock() {
+    static lock_t lock = 0;  // unlocked
+    return &lock;
+}
+
+#endif  // HDF5_LOCK_H_
@@ -29,14 +29,17 @@
 #include <iostream>
 #include <vector>
 #include "galloc.h"
+#include "hdf5_lock.h"
 #include "log.h"
 #include "stats.h"
+#include "stats_arena.h"
 #include "zsim.h"
 
 /** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
  * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
  * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+ * In async mode, dumps only snapshot the raw stat values into a double buffer, and a writer thread does the
+ * aggregation (including summing regular aggregates) and HDF5 I/O off the critical path.
  */
 class HDF5BackendImpl : public GlobAlloc {
     private:
@@ -52,24 +55,38 @@ class HDF5BackendImpl : public GlobAlloc {
 
         uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
 
+        // Async mode: raw snapshots go to snapBufs[curSnap], while the writer thread consumes the other buffer
+        bool async;
+        FlatStats* flatStats; //leaf values in dumpWalk order
+        uint32_t snapWords; //values per snapshot
+        uint32_t snapsPerBuf;
+        uint64_t* snapBufs[2];
+        uint32_t curSnap;
+        uint32_t curSnapRecords;
+        uint32_t pendingSnap;
+        uint32_t pendingRecords;
+        bool pendingFlush; //write out everything after this buffer
+        lock_t readyLock; //unlocked when a buffer is handed to the writer
+        lock_t freeLock; //held while the writer processes a buffer
+
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
             return skipVectors && dynamic_cast<VectorStat*>(s);
         }
 
-        // Dump the stats, inorder walk
-        void dumpWalk(Stat* s) {
+        // Dump the stats, inorder walk. If snap is non-null, reads leaf values from it instead of the stats.
+        void dumpWalk(Stat* s, const uint64_t** snap) {
             if (skipStat(s)) return;
             if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
                 if (as->isRegular() && sumRegularAggregates) {
                     //Dump first record
                     uint64_t* startPtr = curPtr;
-                    dumpWalk(as->get(0));
+                    dumpWalk(as->get(0), snap);
                     uint64_t* tmpPtr = curPtr;
                     uint32_t sz = tmpPtr - startPtr;
                     //Dump others below, and add them up
                     for (uint32_t i = 1; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
+                        dumpWalk(as->get(i), snap);
                         //Add record with previous ones
                         assert(curPtr == tmpPtr + sz);
                         for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
@@ -78,20 +95,46 @@ class HDF5BackendImpl : public GlobAlloc {
                     }
                 } else {
                     for (uint32_t i = 0; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
+                        dumpWalk(as->get(i), snap);
                     }
                 }
             } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *(curPtr++) = ss->get();
+                *(curPtr++) = snap? *((*snap)++) : ss->get();
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
                 for (uint32_t i = 0; i < vs->size(); i++) {
-                    *(curPtr++) = vs->count(i);
+                    *(curPtr++) = snap? *((*snap)++) : vs->count(i);
                 }
             } else {
                 panic("Unrecognized stat type");
             }
         }
 
+        void writeRecords() {
+            futex_lock(hdf5Lock());
+            hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+
+            size_t fieldOffsets[] = {0};
+            size_t fieldSizes[] = {recordSize};
+            H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
+            H5Fclose(fileID);
+            futex_unlock(hdf5Lock());
+
+            //Rewind
+            bufferedRecords = 0;
+            curPtr = dataBuf;
+        }
+
+        // Hands the current snapshot buffer to the writer, waiting for it to finish the previous one
+        void handOff(bool flush) {
+            futex_lock_nospin(&freeLock);
+            pendingSnap = curSnap;
+            pendingRecords = curSnapRecords;
+            pendingFlush = flush;
+            curSnap = 1 - curSnap;
+            curSnapRecords = 0;
+            futex_unlock(&readyLock);
+        }
+
         //Note this is a local vector, b/c it's only used at initialization.
         std::vector<hid_t> uniqueTypes;
 
@@ -218,6 +261,7 @@ class HDF5BackendImpl : public GlobAlloc {
             curPtr = dataBuf;
 
             bufferedRecords = 0;
+            async = false;
 
             info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
             H5Fclose(fileID);
@@ -225,26 +269,58 @@ class HDF5BackendImpl : public GlobAlloc {
 
         ~HDF5BackendImpl() {}
 
+        // Must be called before the first dump; a thread must then run writerLoop()
+        void initAsync(size_t bytesPerWrite) {
+            assert(!async && !bufferedRecords);
+            flatStats = new FlatStats(rootStat, skipVectors);
+            snapWords = flatStats->size();
+            // Snapshots are not compacted, so they can be much larger than records; size buffers by bytes
+            snapsPerBuf = bytesPerWrite/(snapWords*sizeof(uint64_t)) + 1;
+            for (uint32_t b = 0; b < 2; b++) snapBufs[b] = gm_calloc<uint64_t>(snapsPerBuf*snapWords);
+            curSnap = 0;
+            curSnapRecords = 0;
+            futex_init(&readyLock);
+            futex_lock(&readyLock); //starts locked, the writer waits on it
+            futex_init(&freeLock);
+            async = true;
+            info("HDF5 backend: Async dumps for %s, %d bytes/snapshot, %d snapshots/buffer", filename, snapWords*(uint32_t)sizeof(uint64_t), snapsPerBuf);
+        }
+
+        void writerLoop() {
+            assert(async);
+            while (true) {
+                futex_lock_nospin(&readyLock);
+                const uint64_t* snap = snapBufs[pendingSnap];
+                for (uint32_t r = 0; r < pendingRecords; r++) {
+                    dumpWalk(rootStat, &snap);
+                    if (++bufferedRecords == recordsPerWrite) writeRecords();
+                }
+                if (pendingFlush && bufferedRecords) writeRecords();
+                futex_unlock(&freeLock);
+            }
+        }
+
         void dump(bool buffered) {
+            if (async) {
+                // Snapshot raw values; dynamic casts, aggregation, and I/O are left to the writer
+                flatStats->snapshot(snapBufs[curSnap] + curSnapRecords*snapWords);
+                curSnapRecords++;
+                if (curSnapRecords == snapsPerBuf || !buffered) handOff(!buffered);
+                if (!buffered) { //wait until written
+                    futex_lock_nospin(&freeLock);
+                    futex_unlock(&freeLock);
+                }
+                return;
+            }
+
             // Copy stats to data buffer
-            dumpWalk(rootStat);
+            dumpWalk(rootStat, nullptr);
             bufferedRecords++;
 
             assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
 
             // Write to table if needed
-            if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
-
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
-                H5Fclose(fileID);
-
-                //Rewind
-                bufferedRecords = 0;
-                curPtr = dataBuf;
-            }
+            if (bufferedRecords == recordsPerWrite || !buffered) writeRecords();
         }
 };
 
@@ -257,3 +333,11 @@ void HDF5Backend::dump(bool buffered) {
     backend->dump(buffered);
 }
 
+void HDF5Backend::initAsync(size_t bytesPerWrite) {
+    backend->initAsync(bytesPerWrite);
+}
+
+void HDF5Backend::writerLoop() {
+    backend->writerLoop();
+}
+
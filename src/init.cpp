@@ -50,10 +50,12 @@
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "mem_trace.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
 #include "part_repl_policies.h"
+#include "phase_controller.h"
 #include "pin_cmd.h"
 #include "prefetcher.h"
 #include "proc_stats.h"
@@ -70,6 +72,7 @@
 #include "timing_core.h"
 #include "timing_event.h"
 #include "trace_driver.h"
+#include "trace_sampler.h"
 #include "tracing_cache.h"
 #include "virt/port_virtualizer.h"
 #include "weave_md1_mem.h" //validation, could be taken out...
@@ -280,10 +283,20 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             uint32_t tagLat = config.get<uint32_t>(prefix + "tagLat", 5);
             uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
             cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name);
+            zinfo->contentionSim->addDomainLoad(domain, 1.0);
         } else if (type == "Tracing") {
             g_string traceFile = config.get<const char*>(prefix + "traceFile","");
             if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
-            cache = new TracingCache(numLines, cc, array, rp, accLat, invLat, traceFile, name);
+            TracingCache* tc = new TracingCache(numLines, cc, array, rp, accLat, invLat, traceFile, name);
+            if (config.get<bool>(prefix + "analytics", false)) {
+                tc->initAnalytics(new TraceAnalytics(
+                        config.get<double>(prefix + "analyticsRate", 0.01), // initial reuse distance sampling rate
+                        config.get<uint32_t>(prefix + "analyticsLines", 8192), // max lines tracked for reuse distances
+                        config.get<double>(prefix + "analyticsPageRate", 1.0), // page sampling rate for hotness/locality
+                        config.get<uint32_t>(prefix + "analyticsPageLines", 64), // lines per page (<= 64)
+                        config.get<uint64_t>(prefix + "analyticsEpoch", 10000000))); // cycles per page stats epoch
+            }
+            cache = tc;
         } else {
             panic("Invalid cache type %s", type.c_str());
         }
@@ -324,8 +337,40 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
+    // Energy model. 0 devices -> tech default; power-down thresholds are in idle memory cycles, 0 -> never
+    uint32_t devicesPerRank = config.get<uint32_t>(prefix + "devicesPerRank", 0);
+    uint32_t powerDownThreshold = config.get<uint32_t>(prefix + "powerDownThreshold", 0);
+    uint32_t selfRefreshThreshold = config.get<uint32_t>(prefix + "selfRefreshThreshold", 0);
+
+    // Coalescing stage: merge same-row requests arriving within coalesceWindow memory cycles (0 -> off)
+    // into commands of up to maxCoalesceBursts bursts, and combine repeated writes to the same line
+    uint32_t coalesceWindow = config.get<uint32_t>(prefix + "coalesceWindow", 0);
+    uint32_t maxCoalesceBursts = config.get<uint32_t>(prefix + "maxCoalesceBursts", 16);
+    bool writeCombine = config.get<bool>(prefix + "writeCombine", false);
+
+    // Row buffer management: closed, open or adaptive (per-bank hit predictor with a page timeout, plus
+    // a rowHitLimit tuned between 1 and maxAdaptiveRowHits every rowHitEpoch commands). Defaults to closedPage
+    const char* pagePolicy = config.get<const char*>(prefix + "pagePolicy", closedPage? "closed" : "open");
+    uint32_t pageTimeout = config.get<uint32_t>(prefix + "pageTimeout", 64);  // in memory cycles
+    uint32_t rowHitEpoch = config.get<uint32_t>(prefix + "rowHitEpoch", 1024);
+    uint32_t maxAdaptiveRowHits = config.get<uint32_t>(prefix + "maxAdaptiveRowHits", 64);
+
+    // Sequential request chain compaction, see MemoryController::BuildDDRMemory
+    bool compactChains = config.get<bool>(prefix + "compactChains", false);
+    uint32_t maxChainOps = config.get<uint32_t>(prefix + "maxChainOps", 8);
+
+    // Analytic memory model (only this channel skips the weave), see MemoryController::BuildDDRMemory
+    bool analytic = config.get<bool>(prefix + "analyticModel", false);
+    bool analyticCalibrate = config.get<bool>(prefix + "analyticCalibrate", false);
+    double analyticScale = config.get<double>(prefix + "analyticScale", 1.0);
+
     auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
             addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+    mem->initPower(devicesPerRank, powerDownThreshold, selfRefreshThreshold);
+    mem->initCoalescing(coalesceWindow, maxCoalesceBursts, writeCombine);
+    mem->initPagePolicy(pagePolicy, pageTimeout, rowHitEpoch, maxAdaptiveRowHits);
+    mem->initChainCompaction(compactChains, maxChainOps);
+    mem->initAnalytic(analytic, analyticCalibrate, analyticScale);
     return mem;
 }
 
@@ -338,7 +383,9 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
 
     MemObject* mem = nullptr;
     if (type == "Simple") {
-        mem = new SimpleMemory(latency, name, config);
+        SimpleMemory* sm = new SimpleMemory(latency, name, config);
+        sm->initTrace(BuildMemTraceWriter(config, name));
+        mem = sm;
     } else if (type == "DramCache") {
 		mem = new MemoryController(name, frequency, domain, config);
         
@@ -504,6 +551,22 @@ static void InitSystem(Config& config) {
      * it follows that we have a fully connected tree finishing at the LLC.
      */
 
+    //Seed the weave domain loads with the cores, which are built after the memory controllers, so that
+    //autoDomains channels balance around them (timing caches add their load as they are built)
+    if (!zinfo->traceDriven) {
+        vector<const char*> coreGroupNames;
+        config.subgroups("sys.cores", coreGroupNames);
+        for (const char* group : coreGroupNames) {
+            string prefix = string("sys.cores.") + group + ".";
+            uint32_t cores = config.get<uint32_t>(prefix + "cores", 1);
+            string type = config.get<const char*>(prefix + "type", "Simple");
+            for (uint32_t j = 0; j < cores; j++) {
+                if (type == "Timing") zinfo->contentionSim->addDomainLoad(j*zinfo->numDomains/cores, 1.0);
+                else if (type == "OOO") zinfo->contentionSim->addDomainLoad(0, 1.0);  // OOO cores record on domain 0
+            }
+        }
+    }
+
     //Build the memory controllers
     uint32_t memControllers = config.get<uint32_t>("sys.mem.controllers", 1);
     assert(memControllers > 0);
@@ -705,6 +768,7 @@ static void InitSystem(Config& config) {
                     } else {
                         assert(type == "OOO");
                         OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        ocore->setFastChains(config.get<bool>(prefix + "fastChains", true)); //same timing, fewer weave events
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
@@ -764,8 +828,38 @@ static void InitSystem(Config& config) {
         zinfo->traceDriver = new TraceDriver(traceFile, retraceFile, proxies,
                 config.get<bool>("sim.useSkews", true), // incorporate skews in to playback and simulator results, not only the output trace
                 config.get<bool>("sim.playPuts", true),
-                config.get<bool>("sim.playAllGets", true));
+                config.get<bool>("sim.playAllGets", true),
+                config.get<uint32_t>("sim.traceThreads", 1)); // >1 replays children in parallel
         zinfo->traceDriver->initStats(zinfo->rootStat);
+        for (uint32_t i = 0; i < zinfo->traceDriver->getNumHelperThreads(); i++) {
+            PIN_SpawnInternalThread(TraceDriver::HelperThreadTrampoline, zinfo->traceDriver, 1024*1024, nullptr);
+        }
+
+        //Sampled replay: only simulate some intervals of the trace, and extrapolate
+        string sampling = config.get<const char*>("sim.sampling", "None");
+        if (sampling != "None") {
+            TraceSampler::Mode mode;
+            if (sampling == "Systematic") mode = TraceSampler::SYSTEMATIC;
+            else if (sampling == "Random") mode = TraceSampler::RANDOM;
+            else if (sampling == "Clustered") mode = TraceSampler::CLUSTERED;
+            else panic("Invalid sim.sampling %s (valid: None, Systematic, Random, Clustered)", sampling.c_str());
+            uint64_t interval = config.get<uint64_t>("sim.sampleInterval", 10000000);
+            TraceSampler* sampler = new TraceSampler(mode, interval,
+                    config.get<uint64_t>("sim.samplePeriod", 10), // Systematic/Random: measure 1 of every samplePeriod intervals
+                    config.get<uint64_t>("sim.sampleWarmup", interval), // cycles replayed before each measured interval
+                    config.get<uint32_t>("sim.sampleClusters", 10), // Clustered: max number of representative intervals
+                    config.get<uint64_t>("sim.sampleSeed", 1),
+                    config.get<const char*>("sim.sampleStats", ".*"), // regex of the stats to extrapolate
+                    traceFile, g_string(zinfo->outputDir) + "/zsim-sampling.out");
+            zinfo->traceDriver->initSampling(sampler);
+        }
+
+        //Read the trace ahead on a helper thread, so replay does not stall on HDF5 decompression.
+        //HDF5 is not thread-safe, so start it after the sampler, which reads the trace on its own when clustering.
+        AccessTraceReader* tr = zinfo->traceDriver->getTraceReader();
+        if (config.get<bool>("sim.tracePrefetch", true) && tr->startPrefetch()) {
+            PIN_SpawnInternalThread(AccessTraceReader::PrefetchThreadTrampoline, tr, 1024*1024, nullptr);
+        }
     }
 
     //Init stats: caches, mem
@@ -813,11 +907,21 @@ static void PostInitStats(bool perProcessDir, Config& config) {
     const char* cmpStatsFile = gm_strdup((pathStr + testCase + "zsim-cmp.h5").c_str());
     const char* statsFile = gm_strdup((pathStr + testCase + "zsim.out").c_str());
 
+    // Async stats: dumps only snapshot stats, and a thread per backend aggregates and writes them
+    bool asyncStats = config.get<bool>("sim.asyncStats", false);
+    auto initAsyncStats = [asyncStats](HDF5Backend* backend, size_t bytesPerWrite) {
+        if (!asyncStats) return;
+        backend->initAsync(bytesPerWrite);
+        PIN_SpawnInternalThread(HDF5Backend::WriterThreadTrampoline, backend, 1024*1024, nullptr);
+    };
+
     if (zinfo->statsPhaseInterval) {
         const char* periodicStatsFilter = config.get<const char*>("sim.periodicStatsFilter", "");
         AggregateStat* prStat = (!strlen(periodicStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, periodicStatsFilter);
         if (!prStat) panic("No stats match sim.periodicStatsFilter regex (%s)! Set interval to 0 to avoid periodic stats", periodicStatsFilter);
-        zinfo->periodicStatsBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        HDF5Backend* periodicBackend = new HDF5Backend(pStatsFile, prStat, (1 << 20) /* 1MB chunks */, zinfo->skipStatsVectors, zinfo->compactPeriodicStats);
+        initAsyncStats(periodicBackend, 1 << 20);
+        zinfo->periodicStatsBackend = periodicBackend;
         zinfo->periodicStatsBackend->dump(true); //must have a first sample
 
         class PeriodicStatsDumpEvent : public Event {
@@ -835,7 +939,9 @@ static void PostInitStats(bool perProcessDir, Config& config) {
         zinfo->periodicStatsBackend = nullptr;
     }
 
-    zinfo->eventualStatsBackend = new HDF5Backend(evStatsFile, zinfo->rootStat, (1 << 17) /* 128KB chunks */, zinfo->skipStatsVectors, false /* don't sum regular aggregates*/);
+    HDF5Backend* eventualBackend = new HDF5Backend(evStatsFile, zinfo->rootStat, (1 << 17) /* 128KB chunks */, zinfo->skipStatsVectors, false /* don't sum regular aggregates*/);
+    initAsyncStats(eventualBackend, 1 << 17);
+    zinfo->eventualStatsBackend = eventualBackend;
     zinfo->eventualStatsBackend->dump(true); //must have a first sample
     zinfo->statsBackends->push_back(zinfo->eventualStatsBackend);
 
@@ -857,6 +963,36 @@ static void PostInitStats(bool perProcessDir, Config& config) {
     StatsBackend* textStats = new TextBackend(statsFile, zinfo->rootStat);
     zinfo->statsBackends->push_back(compactStats);
     zinfo->statsBackends->push_back(textStats);
+
+    // Live stats: publish (filtered) stats to a shared-memory ring every few phases, for live monitoring (see livestats)
+    if (config.get<bool>("sim.liveStats", false)) {
+        const char* liveStatsFilter = config.get<const char*>("sim.liveStatsFilter", "");
+        AggregateStat* lvStat = (!strlen(liveStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, liveStatsFilter);
+        if (!lvStat) panic("No stats match sim.liveStatsFilter regex (%s)!", liveStatsFilter);
+        string defLiveStatsFile = "/dev/shm/zsim-live-" + Str(zinfo->harnessPid);
+        const char* liveStatsFile = gm_strdup(config.get<const char*>("sim.liveStatsFile", defLiveStatsFile.c_str()));
+        uint32_t liveStatsPhases = config.get<uint32_t>("sim.liveStatsPhases", 100);
+        uint32_t liveStatsFrames = config.get<uint32_t>("sim.liveStatsFrames", 16); //readers only need the last couple of frames
+        bool liveStatsKeep = config.get<bool>("sim.liveStatsKeep", false); //by default, the file is removed when the simulation ends
+        if (!liveStatsPhases) panic("sim.liveStatsPhases must be > 0");
+        if (!liveStatsFrames) panic("sim.liveStatsFrames must be > 0");
+        LiveBackend* liveBackend = new LiveBackend(liveStatsFile, lvStat, liveStatsFrames, (pathStr + testCase).c_str(), zinfo->harnessPid, liveStatsKeep);
+        liveBackend->dump(true); //first frame, so readers get rates from the start
+
+        class LiveStatsDumpEvent : public Event {
+            private:
+                LiveBackend* backend;
+
+            public:
+                LiveStatsDumpEvent(uint32_t period, LiveBackend* _backend) : Event(period), backend(_backend) {}
+                void callback() {
+                    backend->dump(true /*buffered*/);
+                }
+        };
+
+        zinfo->eventQueue->insert(new LiveStatsDumpEvent(liveStatsPhases, liveBackend));
+        zinfo->statsBackends->push_back(liveBackend);
+    }
 }
 
 static void InitGlobalStats() {
@@ -918,16 +1054,48 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    bool weaveStealing = config.get<bool>("sim.weaveStealing", false); //let idle contention threads run other threads' domains
+    uint32_t stealQuantum = config.get<uint32_t>("sim.stealQuantum", 256); //max events per domain slice in stealing mode
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, weaveStealing, stealQuantum);
+    bool deterministicWeave = config.get<bool>("sim.deterministicWeave", false); //weave event order independent of bound-phase interleaving
+    bool weaveSnapshots = config.get<bool>("sim.weaveSnapshots", false); //dump per-domain queue digests at each phase boundary; diff two runs' files to find where they diverge
+    if (deterministicWeave || weaveSnapshots) {
+        string snapshotFile = string(zinfo->outputDir) + "/weave_snapshots.txt";
+        zinfo->contentionSim->initDeterminism(deterministicWeave, weaveSnapshots? snapshotFile.c_str() : nullptr);
+    }
+    if (config.get<bool>("sim.weaveTrace", false)) {
+        //Binary trace of weave events; convert with weavetrace2json. Limit with startPhase/numPhases (0 = all), it grows fast
+        string traceFile = string(zinfo->outputDir) + "/" + config.get<const char*>("sim.weaveTraceFile", "weave.trace");
+        uint32_t bufRecords = config.get<uint32_t>("sim.weaveTraceBufRecords", 64*1024); //per domain
+        uint64_t startPhase = config.get<uint64_t>("sim.weaveTraceStartPhase", 0);
+        uint64_t numPhases = config.get<uint64_t>("sim.weaveTraceNumPhases", 0);
+        zinfo->contentionSim->initWeaveTrace(traceFile.c_str(), bufRecords, startPhase, numPhases);
+    }
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
+    zinfo->memTraceWriters = new g_vector<MemTraceWriter*>();
 
     // Global simulation values
     zinfo->numPhases = 0;
 
     zinfo->phaseLength = config.get<uint32_t>("sim.phaseLength", 10000);
+    zinfo->maxPhaseLength = zinfo->phaseLength;
+    if (config.get<bool>("sim.adaptivePhase", false)) {
+        //Bounds, and thresholds on crossings per 1000 cycles, % of time in weave phase, and % weave thread imbalance
+        uint32_t minPhaseLength = config.get<uint32_t>("sim.minPhaseLength", MAX(zinfo->phaseLength/4, (uint32_t)1));
+        zinfo->maxPhaseLength = config.get<uint32_t>("sim.maxPhaseLength", 4*zinfo->phaseLength);
+        uint32_t crossingsHigh = config.get<uint32_t>("sim.phaseCrossingsHigh", 50);
+        uint32_t crossingsLow = config.get<uint32_t>("sim.phaseCrossingsLow", 5);
+        uint32_t syncHigh = config.get<uint32_t>("sim.phaseSyncHigh", 20);
+        uint32_t skewHigh = config.get<uint32_t>("sim.phaseSkewHigh", 50);
+        if (zinfo->phaseLength < minPhaseLength || zinfo->phaseLength > zinfo->maxPhaseLength) {
+            panic("sim.phaseLength (%d) must be within [sim.minPhaseLength, sim.maxPhaseLength] = [%d, %d]", zinfo->phaseLength, minPhaseLength, zinfo->maxPhaseLength);
+        }
+        zinfo->phaseController = new PhaseLengthController(minPhaseLength, zinfo->maxPhaseLength, crossingsHigh, crossingsLow, syncHigh, skewHigh);
+        zinfo->phaseController->initStats(zinfo->rootStat);
+    }
     zinfo->statsPhaseInterval = config.get<uint32_t>("sim.statsPhaseInterval", 100);
     zinfo->freqMHz = config.get<uint32_t>("sys.frequency", 2000);
 
@@ -1003,6 +1171,11 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     //Caches, cores, memory controllers
     InitSystem(config);
 
+    //Memory traces are compressed and written out in the background, one thread per controller
+    for (MemTraceWriter* tw : *zinfo->memTraceWriters) {
+        PIN_SpawnInternalThread(MemTraceWriter::FlushThreadTrampoline, tw, 256*1024, nullptr);
+    }
+
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
 
@@ -0,0 +1,158 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "live_stats.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "stats_arena.h"
+#include "zsim.h"
+
+/** Implements the live backend. Like the HDF5 backend, dump may be called from multiple processes, so we open the
+ * file and pwrite to it on every dump instead of keeping it mapped. The file is in tmpfs, so this is cheap.
+ */
+class LiveBackendImpl : public GlobAlloc {
+    private:
+        const char* filename;
+        FlatStats* flatStats;
+        uint32_t numFrames;
+        uint64_t framesOffset;
+        uint64_t frameBytes;
+        uint64_t* frameBuf; //LiveFrameHeader + values
+        uint64_t published;
+        bool keep; //if false, the file is unlinked after the final (unbuffered) dump
+        bool closed;
+
+        // Names the leaf values in FlatStats order, omitting the root's name
+        void namesWalk(Stat* s, const std::string& name, std::string& names) {
+            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+                for (uint32_t i = 0; i < as->size(); i++) {
+                    Stat* c = as->get(i);
+                    namesWalk(c, name.empty()? std::string(c->name()) : name + "." + c->name(), names);
+                }
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                names.append(name);
+                names.push_back('\0');
+            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+                for (uint32_t i = 0; i < vs->size(); i++) {
+                    const char* cn = vs->counterName(i);
+                    names.append(name + "." + (cn? std::string(cn) : std::to_string(i)));
+                    names.push_back('\0');
+                }
+            } else {
+                panic("Unrecognized stat type");
+            }
+        }
+
+        void write(int fd, const void* buf, size_t bytes, uint64_t offset) {
+            ssize_t res = pwrite(fd, buf, bytes, offset);
+            if (res != (ssize_t)bytes) panic("Live stats: write to %s failed (%ld/%ld bytes)", filename, res, bytes);
+        }
+
+    public:
+        LiveBackendImpl(const char* _filename, AggregateStat* rootStat, uint32_t _numFrames, const char* label, uint32_t pid, bool _keep) :
+            filename(_filename), numFrames(_numFrames), published(0), keep(_keep), closed(false)
+        {
+            assert(numFrames);
+            flatStats = new FlatStats(rootStat);
+            std::string names;
+            namesWalk(rootStat, "", names);
+
+            LiveStatsHeader hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.magic = LIVE_STATS_MAGIC;
+            hdr.version = LIVE_STATS_VERSION;
+            hdr.pid = pid;
+            hdr.numStats = flatStats->size();
+            hdr.numFrames = numFrames;
+            hdr.namesOffset = sizeof(LiveStatsHeader);
+            hdr.namesBytes = names.size();
+            hdr.framesOffset = (hdr.namesOffset + hdr.namesBytes + 63) & ~63ul;
+            hdr.frameBytes = sizeof(LiveFrameHeader) + hdr.numStats*sizeof(uint64_t);
+            hdr.published = 0;
+            strncpy(hdr.label, label, sizeof(hdr.label) - 1);
+
+            framesOffset = hdr.framesOffset;
+            frameBytes = hdr.frameBytes;
+            frameBuf = gm_calloc<uint64_t>(frameBytes/sizeof(uint64_t));
+
+            int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) panic("Live stats: could not create %s", filename);
+            if (ftruncate(fd, framesOffset + numFrames*frameBytes) != 0) panic("Live stats: could not size %s", filename);
+            write(fd, &hdr, sizeof(hdr), 0);
+            write(fd, names.c_str(), names.size(), hdr.namesOffset);
+            close(fd);
+            info("Live stats: Publishing %d stats to %s, %ld bytes/frame, %d frames", hdr.numStats, filename, frameBytes, numFrames);
+        }
+
+        void dump(bool buffered) {
+            if (closed) return;
+            LiveFrameHeader* fh = reinterpret_cast<LiveFrameHeader*>(frameBuf);
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            fh->seq = published;
+            fh->phase = zinfo->numPhases;
+            fh->cycles = zinfo->globPhaseCycles;
+            fh->wallNs = ts.tv_sec*1000000000ul + ts.tv_nsec;
+            flatStats->snapshot(frameBuf + sizeof(LiveFrameHeader)/sizeof(uint64_t));
+
+            int fd = open(filename, O_WRONLY);
+            if (fd < 0) {
+                warn("Live stats: could not open %s, skipping dump", filename);
+                return;
+            }
+            // Seqlock-style publication, see live_stats.h. Each pwrite completes before the next starts.
+            uint64_t slotOffset = framesOffset + (published % numFrames)*frameBytes;
+            uint64_t invalid = LIVE_SEQ_INVALID;
+            write(fd, &invalid, sizeof(uint64_t), slotOffset);
+            write(fd, frameBuf + 1, frameBytes - sizeof(uint64_t), slotOffset + sizeof(uint64_t));
+            write(fd, frameBuf, sizeof(uint64_t), slotOffset);
+            published++;
+            write(fd, &published, sizeof(uint64_t), offsetof(LiveStatsHeader, published));
+            close(fd);
+
+            // Unbuffered dumps happen at the end of the simulation. Readers that have the file mapped keep the last
+            // frames; remove the file so that finished simulations do not pile up in /dev/shm.
+            if (!buffered) {
+                closed = true;
+                if (!keep && unlink(filename) != 0) warn("Live stats: could not remove %s", filename);
+            }
+        }
+};
+
+
+LiveBackend::LiveBackend(const char* filename, AggregateStat* rootStat, uint32_t numFrames, const char* label, uint32_t pid, bool keep) {
+    backend = new LiveBackendImpl(filename, rootStat, numFrames, label, pid, keep);
+}
+
+void LiveBackend::dump(bool buffered) {
+    backend->dump(buffered);
+}
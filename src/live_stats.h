@@ -0,0 +1,73 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVE_STATS_H_
+#define LIVE_STATS_H_
+
+#include <stdint.h>
+
+/* Live stats export format. LiveBackend publishes stats as fixed-size binary
+ * frames into a ring in a shared-memory file (by default,
+ * /dev/shm/zsim-live-<pid>), which readers mmap read-only (see livestats.cpp).
+ * Nothing is written to disk. File layout:
+ *  - LiveStatsHeader
+ *  - Names: numStats NUL-terminated stat names (e.g., "mem.mem-0.rd"),
+ *    namesBytes in total, starting at namesOffset
+ *  - Ring of numFrames frames of frameBytes each, starting at framesOffset.
+ *    Frame n goes in slot n % numFrames.
+ * Each frame is a LiveFrameHeader followed by numStats uint64_t values.
+ *
+ * Frames work as seqlocks: the writer sets seq to LIVE_SEQ_INVALID, writes
+ * the rest of the frame, sets seq to the frame number, and finally bumps
+ * published. Readers copy the frame between two reads of seq, and retry if
+ * they differ.
+ */
+
+#define LIVE_STATS_MAGIC 0x4556494c4d49535aul  // "ZSIMLIVE"
+#define LIVE_STATS_VERSION 1
+#define LIVE_SEQ_INVALID (~0ul)
+
+struct LiveStatsHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pid;  // of the simulator process that created the file
+    uint32_t numStats;
+    uint32_t numFrames;
+    uint64_t namesOffset;
+    uint64_t namesBytes;
+    uint64_t framesOffset;
+    uint64_t frameBytes;
+    volatile uint64_t published;  // frames published so far
+    char label[256];  // identifies the simulation (output dir and test case)
+};
+
+struct LiveFrameHeader {
+    volatile uint64_t seq;
+    uint64_t phase;
+    uint64_t cycles;
+    uint64_t wallNs;  // CLOCK_REALTIME
+};
+
+#endif  // LIVE_STATS_H_
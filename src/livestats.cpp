@@ -0,0 +1,292 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Live stats reader. Prints stat values and rates of running simulations
+ * that publish live stats (sim.liveStats = true), without touching disk.
+ * With no files, it watches every simulation that publishes to /dev/shm.
+ * Ratios of the deltas of two groups of stats (e.g., hit rates) can be
+ * printed with -r name=num/den, where num and den are regexes; the
+ * deltas of all the stats they match are summed (e.g., across cores).
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <regex>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "live_stats.h"
+#include "log.h"
+
+struct Ratio {
+    std::string name;
+    std::regex num;
+    std::regex den;
+};
+
+class LiveStatsFile {
+    private:
+        const uint8_t* base;
+        size_t size;
+        const LiveStatsHeader* hdr;
+        dev_t dev;
+        ino_t ino;
+        std::vector<uint64_t> prev, cur;  // LiveFrameHeader + values
+        bool hasPrev, hasCur;
+
+    public:
+        std::vector<std::string> names;
+
+        LiveStatsFile() : base(nullptr), size(0), hdr(nullptr), dev(0), ino(0), hasPrev(false), hasCur(false) {}
+
+        ~LiveStatsFile() {
+            if (base) munmap(const_cast<uint8_t*>(base), size);
+        }
+
+        // Returns false if this is not a valid live stats file. Sets retry if it may be one that is still being created.
+        bool open(const std::string& path, bool* retry) {
+            *retry = false;
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LiveStatsHeader)) {
+                if (fd >= 0) close(fd);
+                *retry = true;
+                return false;
+            }
+            size = st.st_size;
+            dev = st.st_dev;
+            ino = st.st_ino;
+            void* m = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (m == MAP_FAILED) return false;
+            base = static_cast<const uint8_t*>(m);
+            hdr = reinterpret_cast<const LiveStatsHeader*>(base);
+            if (hdr->magic == 0 || (hdr->magic == LIVE_STATS_MAGIC && hdr->version == 0)) {
+                *retry = true;
+                return false;
+            }
+            if (hdr->magic != LIVE_STATS_MAGIC || hdr->version != LIVE_STATS_VERSION) {
+                warn("%s: not a live stats file, or unsupported version", path.c_str());
+                return false;
+            }
+            // The simulation sizes the file before writing the header and then the names, so a header that does
+            // not fit or names that are not all there yet are a file caught mid-creation
+            if (hdr->numFrames == 0 || hdr->namesOffset + hdr->namesBytes > size ||
+                    hdr->framesOffset + hdr->numFrames*hdr->frameBytes > size) {
+                *retry = true;
+                return false;
+            }
+            const char* n = reinterpret_cast<const char*>(base + hdr->namesOffset);
+            const char* end = n + hdr->namesBytes;
+            while (n < end) {
+                size_t len = strnlen(n, end - n);
+                if (len == 0 || len == (size_t)(end - n)) break;  // not written yet
+                names.push_back(std::string(n, len));
+                n += len + 1;
+            }
+            if (names.size() != hdr->numStats) {
+                names.clear();
+                *retry = true;
+                return false;
+            }
+            return true;
+        }
+
+        // Simulations unlink their file when they finish (unless sim.liveStatsKeep is set). Our mapping stays valid, but the
+        // file will not change anymore; a new file at the same path is a different simulation.
+        bool removed(const std::string& path) const {
+            struct stat st;
+            return stat(path.c_str(), &st) != 0 || st.st_dev != dev || st.st_ino != ino;
+        }
+
+        const char* label() const {return hdr->label;}
+        uint32_t pid() const {return hdr->pid;}
+
+        // Reads frame seq, or returns false if it was overwritten or is being written
+        bool readFrame(uint64_t seq, std::vector<uint64_t>& dst) const {
+            const uint64_t* src = reinterpret_cast<const uint64_t*>(base + hdr->framesOffset + (seq % hdr->numFrames)*hdr->frameBytes);
+            dst.resize(hdr->frameBytes/sizeof(uint64_t));
+            for (uint32_t retries = 0; retries < 10; retries++) {
+                uint64_t s1 = *static_cast<const volatile uint64_t*>(src);
+                __sync_synchronize();
+                memcpy(&dst[0], src, hdr->frameBytes);
+                __sync_synchronize();
+                uint64_t s2 = *static_cast<const volatile uint64_t*>(src);
+                if (s1 == s2 && s1 == seq) return true;
+                if (s1 != LIVE_SEQ_INVALID && s1 > seq) return false;  // overwritten by a later frame
+                usleep(1000);
+            }
+            return false;
+        }
+
+        // Fetches the latest frame; returns true if it is new
+        bool update() {
+            uint64_t published = hdr->published;
+            if (!published) return false;
+            uint64_t seq = published - 1;
+            if (hasCur && cur[0] == seq) return false;
+            std::vector<uint64_t> f;
+            if (!readFrame(seq, f)) return false;
+            if (hasCur) {
+                prev.swap(cur);
+                hasPrev = true;
+            } else if (seq > 0 && hdr->numFrames > 1) {
+                hasPrev = readFrame(seq - 1, prev);  // so the first report already has rates
+            }
+            cur.swap(f);
+            hasCur = true;
+            return true;
+        }
+
+        void report(const std::regex* filter, const std::vector<Ratio>& ratios, const std::string& path) const {
+            bool alive = kill(hdr->pid, 0) == 0 || errno != ESRCH;
+            printf("== %s (%s, pid %d%s)", hdr->label, path.c_str(), hdr->pid, alive? "" : ", exited");
+            if (!hasCur) {
+                printf(": no frames yet\n");
+                return;
+            }
+            const LiveFrameHeader* c = reinterpret_cast<const LiveFrameHeader*>(&cur[0]);
+            const uint64_t* cv = &cur[sizeof(LiveFrameHeader)/sizeof(uint64_t)];
+            printf(": phase %ld, %.1f Mcycles", c->phase, c->cycles/1e6);
+            if (!hasPrev) {
+                printf("\n");
+                for (uint32_t i = 0; i < names.size(); i++) {
+                    if (filter && regex_match(names[i], *filter)) printf("  %-50s %16ld\n", names[i].c_str(), cv[i]);
+                }
+                return;
+            }
+            const LiveFrameHeader* p = reinterpret_cast<const LiveFrameHeader*>(&prev[0]);
+            const uint64_t* pv = &prev[sizeof(LiveFrameHeader)/sizeof(uint64_t)];
+            double secs = (c->wallNs - p->wallNs)/1e9;
+            double kcycles = (c->cycles - p->cycles)/1e3;
+            printf(", %.2f Mcycles/s\n", (secs > 0)? kcycles/1e3/secs : 0.0);
+            for (uint32_t i = 0; i < names.size(); i++) {
+                if (!filter || !regex_match(names[i], *filter)) continue;
+                double delta = (double)(cv[i] - pv[i]);
+                printf("  %-50s %16ld %14.1f/s %12.3f/kcycle\n", names[i].c_str(), cv[i],
+                        (secs > 0)? delta/secs : 0.0, (kcycles > 0)? delta/kcycles : 0.0);
+            }
+            for (const Ratio& r : ratios) {
+                double num = 0.0, den = 0.0;
+                for (uint32_t i = 0; i < names.size(); i++) {
+                    if (regex_match(names[i], r.num)) num += (double)(cv[i] - pv[i]);
+                    if (regex_match(names[i], r.den)) den += (double)(cv[i] - pv[i]);
+                }
+                if (den > 0) printf("  %-50s %16.4f\n", r.name.c_str(), num/den);
+                else printf("  %-50s %16s\n", r.name.c_str(), "-");
+            }
+        }
+};
+
+static void ScanDir(const char* dir, std::vector<std::string>& paths) {
+    DIR* d = opendir(dir);
+    if (!d) panic("Could not open directory %s", dir);
+    while (struct dirent* e = readdir(d)) {
+        if (strncmp(e->d_name, "zsim-live-", 10) == 0) paths.push_back(std::string(dir) + "/" + e->d_name);
+    }
+    closedir(d);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog("[L] ");
+    double interval = 2.0;
+    uint64_t iterations = 0;
+    const char* filterStr = nullptr;
+    std::vector<Ratio> ratios;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:f:r:")) != -1) {
+        switch (opt) {
+            case 'i': interval = atof(optarg); break;
+            case 'n': iterations = strtoull(optarg, nullptr, 10); break;
+            case 'f': filterStr = optarg; break;
+            case 'r': {
+                std::string spec = optarg;
+                size_t eq = spec.find('=');
+                size_t slash = spec.find('/', eq);
+                if (eq == std::string::npos || slash == std::string::npos) panic("Invalid ratio %s, use name=num/den", optarg);
+                ratios.push_back({spec.substr(0, eq), std::regex(spec.substr(eq + 1, slash - eq - 1)), std::regex(spec.substr(slash + 1))});
+                break;
+            }
+            default:
+                info("Usage: %s [-i secs] [-n iterations] [-f statsRegex] [-r name=numRegex/denRegex]... [file | dir]...", argv[0]);
+                info("  Files default to /dev/shm/zsim-live-*; directories are rescanned for new simulations");
+                exit(1);
+        }
+    }
+    // Without a filter, print all stats unless only ratios were asked for
+    std::regex filter(filterStr? filterStr : ".*");
+    bool printStats = filterStr || ratios.empty();
+
+    std::vector<std::string> args(argv + optind, argv + argc);
+    if (args.empty()) args.push_back("/dev/shm");
+
+    std::map<std::string, LiveStatsFile*> files;
+    for (uint64_t it = 0; !iterations || it < iterations; it++) {
+        if (it) usleep(interval*1e6);
+        std::vector<std::string> paths;
+        for (const std::string& a : args) {
+            struct stat st;
+            if (stat(a.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) ScanDir(a.c_str(), paths);
+            else paths.push_back(a);
+        }
+        for (const std::string& p : paths) {
+            if (files.count(p)) continue;
+            LiveStatsFile* f = new LiveStatsFile();
+            bool retry;
+            if (f->open(p, &retry)) {
+                files[p] = f;
+            } else {
+                delete f;
+                if (!retry) files[p] = nullptr;  // skip from now on
+            }
+        }
+        for (auto it = files.begin(); it != files.end();) {
+            LiveStatsFile* f = it->second;
+            struct stat st;
+            bool removed = f? f->removed(it->first) : stat(it->first.c_str(), &st) != 0;
+            if (f) {
+                f->update();
+                f->report(printStats? &filter : nullptr, ratios, it->first);
+                if (removed) printf("== %s: removed, simulation finished\n", it->first.c_str());
+            }
+            if (removed) {
+                delete f;
+                it = files.erase(it);  // reopened if a new simulation creates it again
+            } else {
+                it++;
+            }
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -1,10 +1,12 @@
 #include "mc.h"
+#include "contention_sim.h"
 #include "line_placement.h"
 #include "page_placement.h"
 #include "os_placement.h"
 #include "mem_ctrls.h"
 #include "dramsim_mem_ctrl.h"
 #include "ddr_mem.h"
+#include "mem_trace.h"
 #include "zsim.h"
 #include <algorithm>
 #include <iostream>
@@ -15,27 +17,16 @@
 MemoryController::MemoryController(g_string &name, uint32_t frequency, uint32_t domain, Config &config)
 	: _name(name)
 {
+	futex_init(&_lock);
 	// Trace Related
-	_collect_trace = config.get<bool>("sys.mem.enableTrace", false);
-	if (_collect_trace && _name == "mem-0")
-	{
-		_cur_trace_len = 0;
-		_max_trace_len = 10000;
-		_trace_dir = config.get<const char *>("sys.mem.traceDir", "./");
-		// FILE * f = fopen((_trace_dir + g_string("/") + _name + g_string("trace.bin")).c_str(), "wb");
-		FILE *f = fopen((_trace_dir + _name + g_string("trace.txt")).c_str(), "w"); // 新增
-		// uint32_t num = 0;
-		fprintf(f, "cycle, address, type\n"); // 新增
-		// fwrite(&num, sizeof(uint32_t), 1, f);
-		fclose(f);
-		futex_init(&_lock);
-	}
+	_trace = BuildMemTraceWriter(config, _name);
 	// 默认为false，cfg文件里也都未指定
 	_sram_tag = config.get<bool>("sys.mem.sram_tag", false);
 	_llc_latency = config.get<uint32_t>("sys.caches.l3.latency",4); // llc-latency = 4ns without l3
 	double timing_scale = config.get<double>("sys.mem.dram_timing_scale", 1);
 	g_string scheme = config.get<const char *>("sys.mem.cache_scheme", "NoCache");
 	_ext_type = config.get<const char *>("sys.mem.ext_dram.type", "Simple");
+	_auto_domains = config.get<bool>("sys.mem.autoDomains", false);
 
 	// following is revised by RL
 	// global_memory_size = config.get<uint32_t>("sim.gmMBytes") * 1024 * 1024;
@@ -509,27 +500,8 @@ MemoryController::access(MemReq &req)
 		return req.cycle;
 	futex_lock(&_lock);
 	// ignore clean LLC eviction
-	if (_collect_trace && _name == "mem-0")
-	{
-		_address_trace[_cur_trace_len] = req.lineAddr;
-		_cycle_trace[_cur_trace_len] = req.cycle;
-		_type_trace[_cur_trace_len] = (req.type == PUTX) ? 1 : 0;
-		_cur_trace_len++;
-		assert(_cur_trace_len <= _max_trace_len);
-		if (_cur_trace_len == _max_trace_len)
-		{
-			// FILE * f = fopen((_trace_dir + g_string("/") + _name + g_string("trace.bin")).c_str(), "ab");
-			FILE *f = fopen((_trace_dir + _name + g_string("trace.txt")).c_str(), "a"); // 使用 "a" 以追加模式打开文件
-			for (size_t i = 0; i < _max_trace_len; i++)
-			{
-				fprintf(f, "%lu, %lx, %u\n", _cycle_trace[i], _address_trace[i], _type_trace[i]);
-			}
-			// fwrite(_address_trace, sizeof(Address), _max_trace_len, f);
-			// fwrite(_type_trace, sizeof(uint32_t), _max_trace_len, f);
-			fclose(f);
-			_cur_trace_len = 0;
-		}
-	}
+	if (_trace)
+		_trace->record(req.cycle, req.lineAddr, req.type, req.srcId);
 
 	_num_requests++;
 	
@@ -1414,6 +1386,7 @@ MemoryController::hybrid2_access(MemReq &req)
 		{
 			// Indicates XTA Hit
 			if_XTA_hit = true;
+			_numXTAHit.inc();
 			// std::cout << "[XTA Hit]" <<std::endl;
 			// XTA Hit 意味着 Page也hit了，page hit 但是cacheline 不一定hit
 			// 首先把LRU的值先改了,本Page LRU置为0，其余计数器+1
@@ -1565,6 +1538,7 @@ MemoryController::hybrid2_access(MemReq &req)
 	if (!if_XTA_hit)
 	{
 		// std::cout << "XM" << std::endl;
+		_numXTAMiss.inc();
 		chbm_miss_cntr += 1;
 		uint64_t current_cycle = req.cycle;
 		// std::cout<< "current_cycle = " << current_cycle <<std::endl;
@@ -1642,6 +1616,7 @@ MemoryController::hybrid2_access(MemReq &req)
 					if(tmp_hbm_tag != static_cast<uint64_t>(0))
 					{
 						DRAMTable[page_addr] = tmp_hbm_tag;
+						_numRemap.inc();
 						// 再次优化逻辑：
 						// 既然我load DRAM数据的时候就已经完成了access的操作，那access cacheline完全可以先做
 						req.lineAddr = tmpAddr;
@@ -1701,6 +1676,7 @@ MemoryController::hybrid2_access(MemReq &req)
 					else
 					{ // 否则按照地址均匀的方式，按地址%mem_hbm_size 映射
 						DRAMTable[page_addr] = page_addr % (_mem_hbm_size / _hybrid2_page_size);
+						_numRemap.inc();
 						Address remap_addr = page_addr % (_mem_hbm_size / _hybrid2_page_size);
 						req.lineAddr = tmpAddr;
 						req.cycle = _ext_dram->access(req,0,4);
@@ -2049,6 +2025,7 @@ MemoryController::hybrid2_access(MemReq &req)
 					// 再更新XTA
 					uint64_t dest_hbm_addr = address % _mem_hbm_size;
 					DRAMTable[address] = dest_hbm_addr;
+					_numRemap.inc();
 					SETEntries[empty_idx]._hybrid2_counter += 1;
 					SETEntries[empty_idx].bit_vector[static_cast<uint32_t>(blk_offset)] = 1;
 				}
@@ -2227,6 +2204,7 @@ MemoryController::bumblebee_access(MemReq& req)
 		// 有空闲HBM
 		if(-1 != free_idx)
 		{
+			_numPRTMissFree.inc();
 			if(page_offset < bumblebee_n && pleEntry.Occupy[page_offset]==0) free_idx = page_offset;
 			pleEntry.PLE[free_idx] = page_offset;
 			pleEntry.Occupy[free_idx] = 1;
@@ -2266,6 +2244,7 @@ MemoryController::bumblebee_access(MemReq& req)
 		}
 		else // 没有空闲HBM：2025/01/10 逻辑重构：根据is_pop，去判断要不要去替换掉cHBM,否则是分配到DDR里
 		{
+			_numPRTMissFull.inc();
 			bleEntry.validVector[blk_offset] = 1;
 			// 原来是DDR
 			if(page_offset >= bumblebee_n)
@@ -2516,6 +2495,7 @@ MemoryController::bumblebee_access(MemReq& req)
 	}
 
 	// PRT Hit
+	_numPRTHit.inc();
 	int dest_mem_idx = search_idx;
 	bool is_cache = pleEntry.Type[dest_mem_idx] == 2 ? true:false;
 	bool block_hit = bleEntry.validVector[blk_offset] ? true:false;
@@ -2825,6 +2805,7 @@ MemoryController::trySwap(PLEEntry& pleEntry,HotnenssTracker& hotTracker,MetaGrp
 
 	hotTracker.DRAMQueue.push_front(_push_dram_page);
 	hotTracker.HBMQueue.push_front(_push_hbm_page);
+	_numSwap.inc();
 
 	int p1_idx = -1;
 	int p2_idx = -1;
@@ -3559,6 +3540,7 @@ void
 MemoryController::tryEvict(PLEEntry& pleEntry,HotnenssTracker& hotTracker,uint64_t current_cycle,g_vector<BLEEntry>& bleEntries,uint64_t set_id,MemReq& req,int sl_state)
 {
 	// int type = sl_state;
+	_numHotEvict.inc();
 	QueuePage endPage = hotTracker.HBMQueue.back();
 	int endPageOffset = endPage._page_id;
 	// 根据value 找到 idx
@@ -3943,8 +3925,52 @@ MemoryController::BuildDDRMemory(Config &config, uint32_t frequency,
 	uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
 	uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10); // in system cycles
 
+	// Energy model. 0 devices -> tech default; power-down thresholds are in idle memory cycles, 0 -> never
+	uint32_t devicesPerRank = config.get<uint32_t>(prefix + "devicesPerRank", 0);
+	uint32_t powerDownThreshold = config.get<uint32_t>(prefix + "powerDownThreshold", 0);
+	uint32_t selfRefreshThreshold = config.get<uint32_t>(prefix + "selfRefreshThreshold", 0);
+
+	// Coalescing stage: merge same-row requests arriving within coalesceWindow memory cycles (0 -> off)
+	// into commands of up to maxCoalesceBursts bursts, and combine repeated writes to the same line
+	uint32_t coalesceWindow = config.get<uint32_t>(prefix + "coalesceWindow", 0);
+	uint32_t maxCoalesceBursts = config.get<uint32_t>(prefix + "maxCoalesceBursts", 16);
+	bool writeCombine = config.get<bool>(prefix + "writeCombine", false);
+
+	// Row buffer management: closed, open or adaptive (per-bank hit predictor with a page timeout, plus
+	// a rowHitLimit tuned between 1 and maxAdaptiveRowHits every rowHitEpoch commands). Defaults to closedPage
+	const char* pagePolicy = config.get<const char*>(prefix + "pagePolicy", closedPage? "closed" : "open");
+	uint32_t pageTimeout = config.get<uint32_t>(prefix + "pageTimeout", 64);  // in memory cycles
+	uint32_t rowHitEpoch = config.get<uint32_t>(prefix + "rowHitEpoch", 1024);
+	uint32_t maxAdaptiveRowHits = config.get<uint32_t>(prefix + "maxAdaptiveRowHits", 64);
+
+	// Represent sequential (type 1) chains of same-direction requests to this channel as one multi-op event of up
+	// to maxChainOps requests; same timing as the uncompacted chain, fewer weave events
+	bool compactChains = config.get<bool>(prefix + "compactChains", false);
+	uint32_t maxChainOps = config.get<uint32_t>(prefix + "maxChainOps", 8);
+
+	// Analytic memory model: time this channel's requests with a queueing model instead of weave events.
+	// Only the channel skips the weave; cores and caches keep their own timing models and weave events.
+	// analyticCalibrate runs the model alongside the full simulation and reports a suggested analyticScale
+	bool analytic = config.get<bool>(prefix + "analyticModel", false);
+	bool analyticCalibrate = config.get<bool>(prefix + "analyticCalibrate", false);
+	double analyticScale = config.get<double>(prefix + "analyticScale", 1.0);
+
+	// Weave-phase placement: with autoDomains, channels leave the parent's domain and are spread over
+	// the contention simulation threads; domainLoad is the channel's expected share of the event load
+	if (_auto_domains)
+	{
+		double domainLoad = config.get<double>(prefix + "domainLoad", 1.0);
+		domain = zinfo->contentionSim->assignDomain(domainLoad);
+		info("%s: assigned to contention domain %d", name.c_str(), domain);
+	}
+
 	auto mem = (DDRMemory *)gm_malloc(sizeof(DDRMemory));
 	new (mem) DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech, addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name, tBL, timing_scale);
+	mem->initPower(devicesPerRank, powerDownThreshold, selfRefreshThreshold);
+	mem->initCoalescing(coalesceWindow, maxCoalesceBursts, writeCombine);
+	mem->initPagePolicy(pagePolicy, pageTimeout, rowHitEpoch, maxAdaptiveRowHits);
+	mem->initChainCompaction(compactChains, maxChainOps);
+	mem->initAnalytic(analytic, analyticCalibrate, analyticScale);
 	printf("GET MEM INFO : %d %d", zinfo->lineSize, pageSize);
 	return mem;
 }
@@ -3988,9 +4014,28 @@ void MemoryController::initStats(AggregateStat *parentStat)
 	_numEvictedLines.init("totalEvictLines", "total # of evicted lines in UnisonCache");
 	memStats->append(&_numEvictedLines);
 
+	_numPRTHit.init("prtHit", "Bumblebee: PRT hits");
+	memStats->append(&_numPRTHit);
+	_numPRTMissFree.init("prtMissFree", "Bumblebee: PRT misses allocated to free HBM");
+	memStats->append(&_numPRTMissFree);
+	_numPRTMissFull.init("prtMissFull", "Bumblebee: PRT misses without free HBM");
+	memStats->append(&_numPRTMissFull);
+	_numHotEvict.init("hotEvict", "Bumblebee: HBM page evictions");
+	memStats->append(&_numHotEvict);
+	_numSwap.init("swap", "Bumblebee: HBM/DRAM page swaps");
+	memStats->append(&_numSwap);
+	_numXTAHit.init("xtaHit", "Hybrid2: XTA hits");
+	memStats->append(&_numXTAHit);
+	_numXTAMiss.init("xtaMiss", "Hybrid2: XTA misses");
+	memStats->append(&_numXTAMiss);
+	_numRemap.init("remap", "Hybrid2: pages remapped");
+	memStats->append(&_numRemap);
+
 	_ext_dram->initStats(memStats);
 	for (uint32_t i = 0; i < _mcdram_per_mc; i++)
 		_mcdram[i]->initStats(memStats);
+	if (_trace)
+		_trace->initStats(memStats);
 
 	parentStat->append(memStats);
 }
@@ -116,6 +116,7 @@ class OSPlacementPolicy;
 
 //class PlacementPolicy;
 class DDRMemory;
+class MemTraceWriter;
 
 class MemoryController : public MemObject {
 private:
@@ -126,13 +127,7 @@ private:
 	// Trace related code
 	lock_t _lock;
 	lock_t _remap_lock;
-	bool _collect_trace;
-	g_string _trace_dir;
-	Address _address_trace[10000];
-	uint64_t _cycle_trace[10000];
-	uint32_t _type_trace[10000];
-	uint32_t _cur_trace_len;
-	uint32_t _max_trace_len;
+	MemTraceWriter* _trace; // nullptr unless sys.mem.enableTrace
 
 	// External Dram Configuration
 	MemObject *	_ext_dram;
@@ -582,29 +577,41 @@ private:
 	// 小于ds_index的cache（HBM）则被标记为disable，未被使用
 	uint64_t _ds_index;
 
+	// If set, each DDR channel gets its own contention domain, balanced by expected load
+	bool _auto_domains;
+
 	// TLB Hack
 	g_unordered_map <Address, TLBEntry> _tlb;
 	uint64_t _os_quantum;
 
-    // Stats
-	Counter _numPlacement;
-  	Counter _numCleanEviction;
-	Counter _numDirtyEviction;
-	Counter _numLoadHit;
-	Counter _numLoadMiss;
-	Counter _numStoreHit;
-	Counter _numStoreMiss;
-	Counter _numCounterAccess; // for FBR placement policy  
-
-	Counter _numTagLoad;
-	Counter _numTagStore;
+    // Stats, updated by all simulation threads
+	ShardedCounter _numPlacement;
+  	ShardedCounter _numCleanEviction;
+	ShardedCounter _numDirtyEviction;
+	ShardedCounter _numLoadHit;
+	ShardedCounter _numLoadMiss;
+	ShardedCounter _numStoreHit;
+	ShardedCounter _numStoreMiss;
+	ShardedCounter _numCounterAccess; // for FBR placement policy  
+
+	ShardedCounter _numTagLoad;
+	ShardedCounter _numTagStore;
 	// For HybridCache	
-	Counter _numTagBufferFlush;
-	Counter _numTBDirtyHit;
-	Counter _numTBDirtyMiss;
+	ShardedCounter _numTagBufferFlush;
+	ShardedCounter _numTBDirtyHit;
+	ShardedCounter _numTBDirtyMiss;
 	// For UnisonCache
-	Counter _numTouchedLines;
-	Counter _numEvictedLines;
+	ShardedCounter _numTouchedLines;
+	ShardedCounter _numEvictedLines;
+	// Per-path counts for Bumblebee and Hybrid2
+	ShardedCounter _numPRTHit;
+	ShardedCounter _numPRTMissFree;
+	ShardedCounter _numPRTMissFull;
+	ShardedCounter _numHotEvict;
+	ShardedCounter _numSwap;
+	ShardedCounter _numXTAHit;
+	ShardedCounter _numXTAMiss;
+	ShardedCounter _numRemap;
 
 	uint64_t _num_hit_per_step;
    	uint64_t _num_miss_per_step;
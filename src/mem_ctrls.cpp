@@ -26,6 +26,7 @@
 //#include "timing_event.h"
 //#include "event_recorder.h"
 #include "mem_ctrls.h"
+#include "mem_trace.h"
 #include "zsim.h"
 
 
@@ -33,40 +34,26 @@ SimpleMemory::SimpleMemory(uint32_t _latency, g_string& _name, Config& config)
 	: name(_name)
 	, latency(_latency) 
 {
-	// trace is collected in mc.cpp.  
-	_collect_trace = false;
-	_cur_trace_len = 0;
-	_max_trace_len = 10000;
+	trace = nullptr;
+	futex_init(&traceLock);
 //	temp = new char[200];
 	temp = nullptr;
-	_trace_dir = config.get<const char *>("sys.mem.traceDir", "./");
-	//_address_trace = new Address[_max_trace_len]; 
-	//_type_trace = new uint32_t[_max_trace_len];
-	if (_collect_trace) {
-		FILE * f = fopen((_trace_dir + g_string("/") + name + g_string("trace.bin")).c_str(), "wb");
-		uint32_t num = 0;
-		fwrite(&num, sizeof(uint32_t), 1, f);
-		fclose(f);
-	    futex_init(&_lock);
-	}
+}
+
+void SimpleMemory::initStats(AggregateStat* parentStat) {
+    if (!trace) return;
+    AggregateStat* memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Memory controller stats");
+    trace->initStats(memStats);
+    parentStat->append(memStats);
 }
 
 uint64_t SimpleMemory::access(MemReq& req) {
-	if (_collect_trace) {
-	    futex_lock(&_lock);
-		_address_trace[_cur_trace_len] = req.lineAddr;
-		_type_trace[_cur_trace_len] = (req.type == PUTS || req.type == PUTX)? 1 : 0;
-		_cur_trace_len ++;
-		assert(_cur_trace_len <= _max_trace_len);
-		if (_cur_trace_len == _max_trace_len) {
-			FILE * f = fopen((_trace_dir + g_string("/") + name + g_string("trace.bin")).c_str(), "ab");
-			fwrite(_address_trace, sizeof(Address), _max_trace_len, f);
-			fwrite(_type_trace, sizeof(uint32_t), _max_trace_len, f);
-			fclose(f);
-			_cur_trace_len = 0;
-		}
-	    futex_unlock(&_lock);
-	}
+    if (trace) {
+        futex_lock(&traceLock);
+        trace->record(req.cycle, req.lineAddr, req.type, req.srcId);
+        futex_unlock(&traceLock);
+    }
 /*	if (temp == nullptr) {
 		//temp = std::new char[2000];
 		temp = (Chunk *) malloc(sizeof(Chunk));
@@ -110,6 +97,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     : zeroLoadLatency(_zeroLoadLatency), name(_name)
 {
     lastPhase = 0;
+    lastPhaseCycles = 0;
 
     double bytesPerCycle = ((double)megabytesPerSecond)/((double)megacyclesPerSecond);
     maxRequestsPerCycle = bytesPerCycle/requestSize;
@@ -125,7 +113,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
 }
 
 void MD1Memory::updateLatency() {
-    uint32_t phaseCycles = (zinfo->numPhases - lastPhase)*(zinfo->phaseLength);
+    uint64_t phaseCycles = zinfo->globPhaseCycles - lastPhaseCycles;
     if (phaseCycles < 10000) return; //Skip with short phases
 
     smoothedPhaseAccesses =  (curPhaseAccesses*0.5) + (smoothedPhaseAccesses*0.5);
@@ -150,6 +138,7 @@ void MD1Memory::updateLatency() {
     curPhaseAccesses = 0;
     __sync_synchronize();
     lastPhase = zinfo->numPhases;
+    lastPhaseCycles = zinfo->globPhaseCycles;
 }
 
 uint64_t MD1Memory::access(MemReq& req) {
@@ -32,29 +32,31 @@
 #include "stats.h"
 #include "config.h"
 
+class MemTraceWriter;
+
 /* Simple memory (or memory bank), has a fixed latency */
 class SimpleMemory : public MemObject {
     private:
-		bool _collect_trace;
-		g_string _trace_dir;
+        MemTraceWriter* trace; // nullptr unless initTrace() is called
+        lock_t traceLock;
 
         g_string name;
         uint32_t latency;
-		Address _address_trace[10000];
-		uint32_t _type_trace[10000];
-		uint32_t _cur_trace_len;
-		uint32_t _max_trace_len;
 
 		struct Chunk {
 			char a[2000];
 		};
 	
-		lock_t _lock;
 		Chunk * temp;
     public:
         uint64_t access(MemReq& req);
         const char* getName() {return name.c_str();}
         SimpleMemory(uint32_t _latency, g_string& _name, Config& config);
+
+        // Traces accesses (sys.mem.enableTrace). Only set on top-level memories,
+        // as MemoryController traces the requests that reach its devices itself
+        void initTrace(MemTraceWriter* _trace) {trace = _trace;}
+        void initStats(AggregateStat* parentStat);
 };
 
 
@@ -64,6 +66,7 @@ class SimpleMemory : public MemObject {
 class MD1Memory : public MemObject {
     private:
         uint64_t lastPhase;
+        uint64_t lastPhaseCycles; //globPhaseCycles at the last update; phases may have different lengths
         double maxRequestsPerCycle;
         double smoothedPhaseAccesses;
         uint32_t zeroLoadLatency;
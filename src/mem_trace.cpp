@@ -0,0 +1,257 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mem_trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "config.h"
+#include "log.h"
+#include "zsim.h"
+
+MemTraceWriter::MemTraceWriter(const g_string& _fileName, uint32_t _bufBytes, bool _compress)
+    : fileName(_fileName), compressBlocks(_compress), bgFlush(false), bufBytes(_bufBytes)
+{
+    assert(bufBytes > 2*MAX_RECORD_BYTES);
+    for (uint32_t i = 0; i < 2; i++) buf[i] = gm_malloc<uint8_t>(bufBytes);
+    compBufBytes = compressBound(bufBytes);
+    compBuf = compressBlocks? gm_malloc<uint8_t>(compBufBytes) : nullptr;
+    curBuf = 0;
+    curBytes = 0;
+    curRecords = 0;
+    lastCycle = 0;
+    lastLineAddr = 0;
+    pendingBuf = 1;
+    pendingBytes = 0;
+    pendingRecords = 0;
+    flushPending = false;
+
+    futex_init(&freeLock);
+    futex_init(&fullLock);
+    futex_lock(&fullLock);  // starts locked, so the flush thread blocks until a buffer fills up
+
+    FILE* f = fopen(fileName.c_str(), "wb");
+    if (!f) panic("Could not open memory trace %s", fileName.c_str());
+    MemTraceHeader hdr = {MEM_TRACE_MAGIC, 1, zinfo->lineSize};
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write memory trace %s", fileName.c_str());
+    fclose(f);
+}
+
+void MemTraceWriter::initStats(AggregateStat* parentStat) {
+    AggregateStat* traceStats = new AggregateStat();
+    traceStats->init("trace", "Memory trace stats");
+    profRecords.init("records", "Traced requests"); traceStats->append(&profRecords);
+    profRawBytes.init("rawBytes", "Encoded bytes before compression"); traceStats->append(&profRawBytes);
+    profFileBytes.init("fileBytes", "Bytes written to the trace file (excluding file header)"); traceStats->append(&profFileBytes);
+    profBlocks.init("blocks", "Blocks written"); traceStats->append(&profBlocks);
+    profStalls.init("stalls", "Full buffers that had to wait for the previous block to be written"); traceStats->append(&profStalls);
+    parentStat->append(traceStats);
+}
+
+void MemTraceWriter::swapBuffers() {
+    if (!bgFlush) {
+        writeBlock(buf[curBuf], curBytes, curRecords);
+    } else {
+        if (flushPending) profStalls.inc();
+        futex_lock(&freeLock);  // wait until the spare buffer is written out
+        pendingBuf = curBuf;
+        pendingBytes = curBytes;
+        pendingRecords = curRecords;
+        flushPending = true;
+        curBuf ^= 1;
+        futex_unlock(&fullLock);  // wake up the flush thread
+    }
+    curBytes = 0;
+    curRecords = 0;
+    lastCycle = 0;
+    lastLineAddr = 0;
+}
+
+void MemTraceWriter::flushLoop() {
+    bgFlush = true;
+    while (true) {
+        futex_lock_nospin(&fullLock);
+        writeBlock(buf[pendingBuf], pendingBytes, pendingRecords);
+        flushPending = false;
+        futex_unlock(&freeLock);
+    }
+}
+
+void MemTraceWriter::flush() {
+    if (bgFlush) futex_lock(&freeLock);  // wait for the in-flight block, if any
+    if (curRecords) {
+        writeBlock(buf[curBuf], curBytes, curRecords);
+        curBytes = 0;
+        curRecords = 0;
+        lastCycle = 0;
+        lastLineAddr = 0;
+    }
+    if (bgFlush) futex_unlock(&freeLock);
+}
+
+void MemTraceWriter::writeBlock(const uint8_t* data, uint32_t bytes, uint32_t records) {
+    MemTraceBlockHeader bh = {records, bytes, bytes, 0};
+    const uint8_t* payload = data;
+    if (compressBlocks) {
+        uLongf compBytes = compBufBytes;
+        // Level 1: the trace is already compact, and compression speed is what bounds tracing overheads
+        if (compress2(compBuf, &compBytes, data, bytes, 1) == Z_OK && compBytes < bytes) {
+            bh.compBytes = compBytes;
+            payload = compBuf;
+        }
+    }
+
+    // Reopened on every block, as blocks may be written by different processes
+    FILE* f = fopen(fileName.c_str(), "ab");
+    if (!f) panic("Could not open memory trace %s", fileName.c_str());
+    if (fwrite(&bh, sizeof(bh), 1, f) != 1 || fwrite(payload, 1, bh.compBytes, f) != bh.compBytes) {
+        panic("Could not write memory trace %s", fileName.c_str());
+    }
+    fclose(f);
+
+    profRecords.inc(records);
+    profRawBytes.inc(bytes);
+    profFileBytes.inc(sizeof(bh) + bh.compBytes);
+    profBlocks.inc();
+}
+
+MemTraceReader::MemTraceReader(const char* fileName) {
+    f = fopen(fileName, "rb");
+    if (!f) panic("Could not open memory trace %s", fileName);
+    raw = comp = nullptr;
+    rawCap = compCap = 0;
+    cur = end = nullptr;
+    blockRecords = 0;
+    lastCycle = 0;
+    lastLineAddr = 0;
+
+    MemTraceHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == MEM_TRACE_MAGIC) {
+        if (hdr.version != 1) panic("%s: unsupported memory trace version %d", fileName, hdr.version);
+        text = false;
+    } else {
+        // Older text traces start with a "cycle, address, type" header line
+        rewind(f);
+        char line[256];
+        if (!fgets(line, sizeof(line), f) || strncmp(line, "cycle", 5) != 0) panic("%s is not a memory trace", fileName);
+        text = true;
+    }
+}
+
+MemTraceReader::~MemTraceReader() {
+    fclose(f);
+    free(raw);
+    free(comp);
+}
+
+bool MemTraceReader::read(MemTraceRecord& rec) {
+    if (text) return readText(rec);
+    while (!blockRecords) {
+        if (!nextBlock()) return false;
+    }
+    lastCycle += MemTraceWriter::unzigzag(getVarint());
+    lastLineAddr += MemTraceWriter::unzigzag(getVarint());
+    uint64_t v = getVarint();
+    rec.cycle = lastCycle;
+    rec.lineAddr = lastLineAddr;
+    rec.type = (AccessType)(v & 0x3);
+    rec.srcId = v >> 2;
+    blockRecords--;
+    return true;
+}
+
+bool MemTraceReader::readText(MemTraceRecord& rec) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        char* e;
+        rec.cycle = strtoull(p, &e, 10);
+        if (e == p || *e != ',') continue;  // blank or malformed line
+        p = e + 1;
+        rec.lineAddr = strtoull(p, &e, 16);
+        if (e == p || *e != ',') continue;
+        p = e + 1;
+        bool isWrite = strtoul(p, &e, 10) != 0;
+        if (e == p) continue;
+        rec.type = isWrite? PUTX : GETS;
+        rec.srcId = 0;
+        return true;
+    }
+    return false;
+}
+
+bool MemTraceReader::nextBlock() {
+    MemTraceBlockHeader bh;
+    size_t n = fread(&bh, 1, sizeof(bh), f);
+    if (n == 0) return false;
+    if (n != sizeof(bh) || bh.compBytes > bh.rawBytes) panic("Corrupted memory trace block header");
+
+    if (bh.rawBytes > rawCap) {
+        rawCap = bh.rawBytes;
+        raw = static_cast<uint8_t*>(realloc(raw, rawCap));
+    }
+    if (bh.compBytes == bh.rawBytes) {
+        if (fread(raw, 1, bh.rawBytes, f) != bh.rawBytes) panic("Truncated memory trace block");
+    } else {
+        if (bh.compBytes > compCap) {
+            compCap = bh.compBytes;
+            comp = static_cast<uint8_t*>(realloc(comp, compCap));
+        }
+        if (fread(comp, 1, bh.compBytes, f) != bh.compBytes) panic("Truncated memory trace block");
+        uLongf rawBytes = bh.rawBytes;
+        if (uncompress(raw, &rawBytes, comp, bh.compBytes) != Z_OK || rawBytes != bh.rawBytes) {
+            panic("Could not decompress memory trace block");
+        }
+    }
+
+    cur = raw;
+    end = raw + bh.rawBytes;
+    blockRecords = bh.numRecords;
+    lastCycle = 0;
+    lastLineAddr = 0;
+    return true;
+}
+
+uint64_t MemTraceReader::getVarint() {
+    uint64_t v = 0;
+    uint32_t shift = 0;
+    while (true) {
+        if (cur == end || shift > 63) panic("Corrupted memory trace block");
+        uint8_t b = *cur++;
+        v |= ((uint64_t)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) return v;
+        shift += 7;
+    }
+}
+
+MemTraceWriter* BuildMemTraceWriter(Config& config, const g_string& name) {
+    if (!config.get<bool>("sys.mem.enableTrace", false)) return nullptr;
+    g_string traceDir = config.get<const char*>("sys.mem.traceDir", "./");
+    uint32_t bufKB = config.get<uint32_t>("sys.mem.traceBufKB", 1024);
+    bool compress = config.get<bool>("sys.mem.traceCompress", true);
+    MemTraceWriter* tw = new MemTraceWriter(traceDir + name + "trace.bin", bufKB*1024, compress);
+    if (zinfo->memTraceWriters) zinfo->memTraceWriters->push_back(tw);  // flushed at the end of the simulation
+    return tw;
+}
@@ -0,0 +1,187 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEM_TRACE_H_
+#define MEM_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "g_std/g_string.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class Config;
+
+/* Compact binary traces of the requests that reach a memory controller
+ * (sys.mem.enableTrace), replayable with memreplay.
+ *
+ * Records are delta-encoded against the previous record of the same block
+ * (zigzag varints for cycle and line address, then a varint with the
+ * requester id and access type), so a typical record takes 4-6 bytes before
+ * compression. Blocks are then compressed with zlib and written out, either
+ * by the filling thread or, once a flush thread is started, in the
+ * background while the other of the two buffers fills up. Each block starts
+ * from zero deltas, so blocks decode independently.
+ *
+ * File layout: MemTraceHeader, then blocks of MemTraceBlockHeader followed
+ * by compBytes of payload (raw if compBytes == rawBytes).
+ */
+
+#define MEM_TRACE_MAGIC 0x314352544d454d5aul  // "ZMEMTRC1"
+
+struct MemTraceHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t lineSize;
+};
+
+struct MemTraceBlockHeader {
+    uint32_t numRecords;
+    uint32_t rawBytes;
+    uint32_t compBytes;
+    uint32_t pad;
+};
+
+struct MemTraceRecord {
+    uint64_t cycle;
+    Address lineAddr;
+    AccessType type;
+    uint32_t srcId;
+};
+
+class MemTraceWriter : public GlobAlloc {
+    private:
+        static const uint32_t MAX_RECORD_BYTES = 32;  // 3 varints of at most 10 bytes
+
+        g_string fileName;
+        bool compressBlocks;
+        uint8_t* compBuf;
+        uint32_t compBufBytes;
+        volatile bool bgFlush;
+
+        // Double buffer; callers fill buf[curBuf] while the flush thread writes out the other one
+        uint8_t* buf[2];
+        uint32_t bufBytes;
+        uint32_t curBuf;
+        uint32_t curBytes;
+        uint32_t curRecords;
+        uint64_t lastCycle;
+        Address lastLineAddr;
+
+        // Buffer handed to the flush thread
+        uint32_t pendingBuf;
+        uint32_t pendingBytes;
+        uint32_t pendingRecords;
+        volatile bool flushPending;
+
+        lock_t freeLock;  // held while the spare buffer is being written out
+        lock_t fullLock;  // unlocked to wake up the flush thread
+
+        Counter profRecords, profRawBytes, profFileBytes, profBlocks, profStalls;
+
+    public:
+        // Callers must serialize record() calls (memory controllers hold their lock)
+        MemTraceWriter(const g_string& _fileName, uint32_t _bufBytes, bool _compress);
+
+        void initStats(AggregateStat* parentStat);
+
+        inline void record(uint64_t cycle, Address lineAddr, AccessType type, uint32_t srcId) {
+            uint8_t* p = buf[curBuf] + curBytes;
+            p = putVarint(p, zigzag(cycle - lastCycle));
+            p = putVarint(p, zigzag(lineAddr - lastLineAddr));
+            p = putVarint(p, (((uint64_t)srcId) << 2) | (uint64_t)type);
+            lastCycle = cycle;
+            lastLineAddr = lineAddr;
+            curBytes = p - buf[curBuf];
+            curRecords++;
+            if (unlikely(curBytes + MAX_RECORD_BYTES > bufBytes)) swapBuffers();
+        }
+
+        // Writes out buffered records; call at the end of the simulation
+        void flush();
+
+        // Loops writing out full buffers; runs in a dedicated internal thread
+        void flushLoop();
+        static void FlushThreadTrampoline(void* arg) {
+            static_cast<MemTraceWriter*>(arg)->flushLoop();
+        }
+
+        static inline uint64_t zigzag(uint64_t delta) {
+            return (delta << 1) ^ (uint64_t)(((int64_t)delta) >> 63);
+        }
+
+        static inline uint64_t unzigzag(uint64_t v) {
+            return (v >> 1) ^ (uint64_t)(-(int64_t)(v & 1));
+        }
+
+    private:
+        static inline uint8_t* putVarint(uint8_t* p, uint64_t v) {
+            while (v >= 0x80) {
+                *p++ = (uint8_t)(v | 0x80);
+                v >>= 7;
+            }
+            *p++ = (uint8_t)v;
+            return p;
+        }
+
+        void swapBuffers();
+        void writeBlock(const uint8_t* data, uint32_t bytes, uint32_t records);
+};
+
+/* Reads binary traces, and also the text traces (header "cycle, address,
+ * type", then "cycle, hex lineAddr, isWrite" lines) written by older versions
+ */
+class MemTraceReader {
+    private:
+        FILE* f;
+        bool text;
+        uint8_t* raw;
+        uint8_t* comp;
+        uint32_t rawCap, compCap;
+        const uint8_t* cur;
+        const uint8_t* end;
+        uint32_t blockRecords;
+        uint64_t lastCycle;
+        Address lastLineAddr;
+
+    public:
+        explicit MemTraceReader(const char* fileName);
+        ~MemTraceReader();
+
+        bool isText() const {return text;}
+        bool read(MemTraceRecord& rec);
+
+    private:
+        bool readText(MemTraceRecord& rec);
+        bool nextBlock();
+        uint64_t getVarint();
+};
+
+// Returns a writer for <sys.mem.traceDir><name>trace.bin if sys.mem.enableTrace is set, or nullptr
+MemTraceWriter* BuildMemTraceWriter(Config& config, const g_string& name);
+
+#endif  // MEM_TRACE_H_
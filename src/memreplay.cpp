@@ -0,0 +1,179 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Replays a memory-level trace (the mem-Ntrace.bin files written with
+ * sys.mem.enableTrace, or older text traces) into a MemoryController,
+ * without Pin or the rest of the simulator. The controller is built from a normal zsim config, so any
+ * sys.mem.cache_scheme and its DDR/MD1/Simple devices can be driven directly.
+ * There are no cores or caches and no weave phase: memories see no event
+ * recorders, so they return their bound-phase latencies, and phases advance
+ * with the trace's cycles so that load-dependent models update as in zsim.
+ * Since DDR scheduling is only simulated in the weave phase, set analytic =
+ * true on DDR devices to get queueing delays.
+ *
+ * Instead of a trace, synth:<pattern> replays a synthetic stream (see
+ * synth_streams.h), configured with the synth.* keys of the config.
+ *
+ * Writes the controller's stats to memreplay.out and memreplay.h5 in the
+ * current directory, and reports host throughput, which makes this a
+ * repeatable benchmark for the memory models.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "config.h"
+#include "contention_sim.h"
+#include "event_recorder.h"
+#include "galloc.h"
+#include "log.h"
+#include "mc.h"
+#include "mem_trace.h"
+#include "memory_hierarchy.h"
+#include "profile_stats.h"
+#include "stats.h"
+#include "synth_streams.h"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+
+/* ContentionSim stubs. Without event recorders nothing is recorded, so the
+ * only enqueues happen while memories are built (e.g., DDR refresh events);
+ * these are dropped, as there is no weave phase to run them.
+ */
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle, uint32_t srcId) {}
+
+void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
+    panic("memreplay has no weave phase");
+}
+
+void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    panic("memreplay has no weave phase");
+}
+
+uint32_t ContentionSim::assignDomain(double load) {
+    return 0;  // single domain
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc != 3 && argc != 4) {
+        info("Replays a memory controller trace through the memory models of a zsim config");
+        info("Usage: %s <config> <trace | synth:<pattern>> [maxRequests]", argv[0]);
+        info("  patterns: stream, stride, zipf, phases, chase (maxRequests defaults to 10M)");
+        exit(1);
+    }
+    bool synthetic = strncmp(argv[2], "synth:", 6) == 0;
+    uint64_t maxRequests = (argc == 4)? strtoull(argv[3], nullptr, 10) : (synthetic? 10000000 : 0);
+
+    Config config(argv[1]);
+    uint32_t gmSize = config.get<uint32_t>("sim.gmMBytes", (1<<10));
+    gm_init(((size_t)gmSize) << 20);
+
+    // Stub zinfo, with the fields the memory models use
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = config.get<uint32_t>("sys.lineSize", 64);
+    zinfo->freqMHz = config.get<uint32_t>("sys.frequency", 2000);
+    zinfo->phaseLength = config.get<uint32_t>("sim.phaseLength", 10000);
+    zinfo->maxPhaseLength = zinfo->phaseLength;
+    zinfo->numDomains = 1;
+    zinfo->numPhases = 0;
+    zinfo->globPhaseCycles = 0;
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(MAX_THREADS);
+    zinfo->contentionSim = gm_calloc<ContentionSim>();  // only used through the stubs above
+    zinfo->memTraceWriters = new g_vector<MemTraceWriter*>();
+
+    std::string type = config.get<const char*>("sys.mem.type", "Simple");
+    if (type != "DramCache") warn("sys.mem.type is %s; memreplay always drives a DramCache controller", type.c_str());
+
+    zinfo->rootStat = new AggregateStat();
+    zinfo->rootStat->init("root", "Stats");
+    g_string name("mem-0");
+    MemoryController* mc = new MemoryController(name, zinfo->freqMHz, 0, config);
+    AggregateStat* memStat = new AggregateStat();
+    memStat->init("mem", "Memory controller stats");
+    mc->initStats(memStat);
+    zinfo->rootStat->append(memStat);
+
+    Counter profRequests, profReads, profWrites, profTotalLat;
+    AggregateStat* replayStat = new AggregateStat();
+    replayStat->init("replay", "Trace replay stats");
+    profRequests.init("reqs", "Requests replayed"); replayStat->append(&profRequests);
+    profReads.init("rd", "Read requests"); replayStat->append(&profReads);
+    profWrites.init("wr", "Write requests"); replayStat->append(&profWrites);
+    profTotalLat.init("totLat", "Total request latency (cycles)"); replayStat->append(&profTotalLat);
+    zinfo->rootStat->append(replayStat);
+    zinfo->rootStat->makeImmutable();
+
+    StatsBackend* textStats = new TextBackend("memreplay.out", zinfo->rootStat);
+    StatsBackend* h5Stats = new HDF5Backend("memreplay.h5", zinfo->rootStat, 0, false, true);
+
+    MemTraceReader* tr = synthetic? nullptr : new MemTraceReader(argv[2]);
+    SynthStream* synth = synthetic? BuildSynthStream(config, argv[2] + 6, zinfo->lineSize) : nullptr;
+    MemTraceRecord rec;
+    uint64_t startNs = getNs();
+    uint64_t lastReportNs = startNs;
+    while (!maxRequests || profRequests.get() < maxRequests) {
+        if (synth) synth->next(rec);
+        else if (!tr->read(rec)) break;
+
+        // Advance phases with the trace, so phase-based load estimates update as in zsim
+        uint64_t phase = rec.cycle/zinfo->phaseLength;
+        if (phase > zinfo->numPhases) {
+            zinfo->numPhases = phase;
+            zinfo->globPhaseCycles = phase*zinfo->phaseLength;
+        }
+
+        MESIState state = I;
+        uint32_t srcId = (rec.srcId < MAX_THREADS)? rec.srcId : 0;
+        MemReq req = {rec.lineAddr, rec.type, 0, &state, rec.cycle, nullptr, I, srcId, 0};
+        uint64_t respCycle = mc->access(req);
+        if (synth) synth->complete(respCycle);
+        profRequests.inc();
+        if (IsPut(rec.type)) profWrites.inc();
+        else profReads.inc();
+        profTotalLat.inc(respCycle - rec.cycle);
+
+        if ((profRequests.get() & 0xffff) == 0) {
+            uint64_t ns = getNs();
+            if (ns - lastReportNs > 5000000000ul) {
+                info("%ld requests, %.2f Mreq/s", profRequests.get(), profRequests.get()*1e3/(ns - startNs));
+                lastReportNs = ns;
+            }
+        }
+    }
+    uint64_t hostNs = getNs() - startNs;
+
+    for (MemTraceWriter* t : *zinfo->memTraceWriters) t->flush();
+    textStats->dump(false);
+    h5Stats->dump(false);
+
+    uint64_t reqs = profRequests.get();
+    info("Replayed %ld requests (%ld reads, %ld writes) in %.3f s: %.0f requests/s (%.1f ns/request), avg latency %.1f cycles",
+            reqs, profReads.get(), profWrites.get(), hostNs/1e9, hostNs? reqs*1e9/hostNs : 0.0,
+            reqs? ((double)hostNs)/reqs : 0.0, reqs? ((double)profTotalLat.get())/reqs : 0.0);
+    return 0;
+}
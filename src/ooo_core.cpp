@@ -107,6 +107,13 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     coreStat->append(approxInstrsStat);
     coreStat->append(mispredBranchesStat);
 
+    auto fastChainsStat = makeLambdaStat([this]() { return cRec.getFastChains(); });
+    fastChainsStat->init("fastChains", "Miss event chains built in compact form");
+    coreStat->append(fastChainsStat);
+    auto fullChainsStat = makeLambdaStat([this]() { return cRec.getFullChains(); });
+    fullChainsStat->init("fullChains", "Miss event chains linked to outstanding responses");
+    coreStat->append(fullChainsStat);
+
 #ifdef OOO_STALL_STATS
     profFetchStalls.init("fetchStalls",  "Fetch stalls");  coreStat->append(&profFetchStalls);
     profDecodeStalls.init("decodeStalls", "Decode stalls"); coreStat->append(&profDecodeStalls);
@@ -117,7 +124,7 @@ void OOOCore::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t OOOCore::getInstrs() const {return instrs;}
-uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
+uint64_t OOOCore::getPhaseCycles() const {return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;}
 
 void OOOCore::contextSwitch(int32_t gid) {
     if (gid == -1) {
@@ -516,6 +523,7 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
         // This is fine, since the loop looks at core values directly and there are no locals involved,
         // so we should just advance as needed and move on.
         if (newCid != cid) break;  /*context-switch, we do not own this context anymore*/
+        core->phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength;  // phase length may have changed at the barrier
     }
 }
 
@@ -451,6 +451,7 @@ class OOOCore : public Core {
 
         // Contention simulation interface
         inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
+        void setFastChains(bool enable) {cRec.setFastChains(enable);}
         void cSimStart();
         void cSimEnd();
 
@@ -116,6 +116,9 @@ OOOCoreRecorder::OOOCoreRecorder(uint32_t _domain, g_string& _name)
     lastEvProduced = nullptr;
     lastEvSimulatedZllStartCycle = 0;
     lastEvSimulatedStartCycle = 0;
+
+    fastChains = true;
+    numFastChains = numFullChains = 0;
 }
 
 
@@ -133,7 +136,7 @@ uint64_t OOOCoreRecorder::notifyJoin(uint64_t curCycle) {
         lastEvProduced = new (eventRecorder) OOOIssueEvent(0, curCycle - gapCycles, this, domain);
         lastEvProduced->id = curId++;
         lastEvProduced->setMinStartCycle(curCycle);
-        lastEvProduced->queue(curCycle);
+        lastEvProduced->queue(curCycle, eventRecorder.getSourceId());
         eventRecorder.setStartSlack(0);
         DEBUG_MSG("[%s] Joined, was HALTED, curCycle %ld halted %ld", name.c_str(), curCycle, totalHaltedCycles);
     } else if (state == DRAINING) {
@@ -158,6 +161,16 @@ void OOOCoreRecorder::addIssueEvent(uint64_t evCycle) {
     assert_msg(zllCycle >= lastEvProduced->zllStartCycle, "zllCycle %ld last %ld", zllCycle, lastEvProduced->zllStartCycle);
     OOOIssueEvent* ev = new (eventRecorder) OOOIssueEvent(0, zllCycle, this, domain);
     ev->id = curId++;
+
+    if (fastChains && !respPrecedes(zllCycle)) {
+        //The prior issue event is the only parent, so it can carry the issue delay instead of a DelayEvent
+        ev->setPreDelay(zllCycle - lastEvProduced->zllStartCycle);
+        lastEvProduced->addChild(ev, eventRecorder);
+        ev->setMinStartCycle(evCycle);
+        lastEvProduced = ev;
+        return;
+    }
+
     // 1. Link with prior (<) outstanding responses
     uint64_t maxCycle = 0;
     while (!futureResponses.empty()) {
@@ -223,27 +236,38 @@ void OOOCoreRecorder::recordAccess(uint64_t curCycle, uint64_t dispatchCycle, ui
 
         addIssueEvent(curCycle);
 
-        //Delay
-        DelayEvent* dDisp = new (eventRecorder) DelayEvent(dispatchCycle - curCycle);
-        dDisp->setMinStartCycle(curCycle);
-
-        //Dispatch event
-        OOODispatchEvent* dispEv = new (eventRecorder) OOODispatchEvent(/*dispatchCycle - curCycle*/ 0, dispatchCycle);
-        dispEv->setMinStartCycle(dispatchCycle);
-        dispEv->id = curId++;
-
         uint64_t zllDispatchCycle = dispatchCycle - gapCycles;
-        //Traverse min heap, link with preceding resps...
-        for (FutureResponse& fr : GetPrioQueueContainer(futureResponses)) {
-            if (fr.zllStartCycle < zllDispatchCycle && fr.ev) {
-                DelayEvent* dl = new (eventRecorder) DelayEvent(zllDispatchCycle - fr.zllStartCycle);
-                fr.ev->addChild(dl, eventRecorder)->addChild(dispEv, eventRecorder);
+        if (fastChains && !respPrecedes(zllDispatchCycle)) {
+            //Common shape in streaming code: no response gates dispatch, so the dispatch event would
+            //have a single parent and add no delay. Link the request through one delay instead; it
+            //has dUp's minStartCycle, so crossings to the request's domain are the same
+            DelayEvent* dReq = new (eventRecorder) DelayEvent(tr.reqCycle - curCycle);
+            dReq->setMinStartCycle(dispatchCycle);
+            lastEvProduced->addChild(dReq, eventRecorder)->addChild(tr.startEvent, eventRecorder);
+            numFastChains++;
+        } else {
+            //Delay
+            DelayEvent* dDisp = new (eventRecorder) DelayEvent(dispatchCycle - curCycle);
+            dDisp->setMinStartCycle(curCycle);
+
+            //Dispatch event
+            OOODispatchEvent* dispEv = new (eventRecorder) OOODispatchEvent(/*dispatchCycle - curCycle*/ 0, dispatchCycle);
+            dispEv->setMinStartCycle(dispatchCycle);
+            dispEv->id = curId++;
+
+            //Traverse min heap, link with preceding resps...
+            for (FutureResponse& fr : GetPrioQueueContainer(futureResponses)) {
+                if (fr.zllStartCycle < zllDispatchCycle && fr.ev) {
+                    DelayEvent* dl = new (eventRecorder) DelayEvent(zllDispatchCycle - fr.zllStartCycle);
+                    fr.ev->addChild(dl, eventRecorder)->addChild(dispEv, eventRecorder);
+                }
             }
+            //Link request
+            DelayEvent* dUp = new (eventRecorder) DelayEvent(tr.reqCycle - dispatchCycle); //TODO: remove, postdelay in dispatch...
+            dUp->setMinStartCycle(dispatchCycle);
+            lastEvProduced->addChild(dDisp, eventRecorder)->addChild(dispEv, eventRecorder)->addChild(dUp, eventRecorder)->addChild(tr.startEvent, eventRecorder);
+            numFullChains++;
         }
-        //Link request
-        DelayEvent* dUp = new (eventRecorder) DelayEvent(tr.reqCycle - dispatchCycle); //TODO: remove, postdelay in dispatch...
-        dUp->setMinStartCycle(dispatchCycle);
-        lastEvProduced->addChild(dDisp, eventRecorder)->addChild(dispEv, eventRecorder)->addChild(dUp, eventRecorder)->addChild(tr.startEvent, eventRecorder);
 
         //Link response
         assert(respCycle >= tr.respCycle);
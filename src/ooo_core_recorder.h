@@ -88,9 +88,15 @@ class OOOCoreRecorder {
         uint32_t domain;
         g_string name;
 
+        //Compact chains for the common shape where no outstanding response gates an issue or dispatch (see recordAccess)
+        bool fastChains;
+        uint64_t numFastChains, numFullChains; //GET chains built each way
+
     public:
         OOOCoreRecorder(uint32_t _domain, g_string& _name);
 
+        void setFastChains(bool enable) {fastChains = enable;}
+
         //Methods called in the bound phase
         uint64_t notifyJoin(uint64_t curCycle); //returns th updated curCycle, if it needs updating
         void notifyLeave(uint64_t curCycle);
@@ -113,12 +119,19 @@ class OOOCoreRecorder {
         //Stats (called fully synchronized)
         uint64_t getUnhaltedCycles(uint64_t curCycle) const;
         uint64_t getContentionCycles() const;
+        uint64_t getFastChains() const {return numFastChains;}
+        uint64_t getFullChains() const {return numFullChains;}
 
         const g_string& getName() const {return name;}
 
     private:
         void recordAccess(uint64_t curCycle, uint64_t dispatchCycle, uint64_t respCycle);
         void addIssueEvent(uint64_t evCycle);
+
+        //True if some outstanding response may have to be linked before zllCycle
+        inline bool respPrecedes(uint64_t zllCycle) {
+            return !futureResponses.empty() && futureResponses.top().zllStartCycle < zllCycle;
+        }
 };
 
 #endif  // OOO_CORE_RECORDER_H_
@@ -0,0 +1,82 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "phase_controller.h"
+#include "contention_sim.h"
+#include "profile_stats.h"
+#include "zsim.h"
+
+PhaseLengthController::PhaseLengthController(uint32_t _minLength, uint32_t _maxLength, uint32_t _crossingsHigh, uint32_t _crossingsLow,
+        uint32_t _syncHigh, uint32_t _skewHigh)
+    : minLength(_minLength), maxLength(_maxLength), crossingsHigh(_crossingsHigh), crossingsLow(_crossingsLow),
+      syncHigh(_syncHigh), skewHigh(_skewHigh), lastBoundNs(0), lastWeaveNs(0)
+{
+    if (minLength == 0 || minLength > maxLength) panic("Invalid phase length bounds [%d, %d]", minLength, maxLength);
+    if (crossingsLow > crossingsHigh) panic("phaseCrossingsLow (%d) must not exceed phaseCrossingsHigh (%d)", crossingsLow, crossingsHigh);
+    info("Adaptive phase length: [%d, %d] cycles, crossings/Kcycle [%d, %d], sync %d%%, skew %d%%",
+            minLength, maxLength, crossingsLow, crossingsHigh, syncHigh, skewHigh);
+}
+
+void PhaseLengthController::initStats(AggregateStat* parentStat) {
+    AggregateStat* ctrlStat = new AggregateStat();
+    ctrlStat->init("phaseCtrl", "Adaptive phase length stats");
+    // Sampled by the periodic stats backend, this is the time series of chosen lengths
+    auto lenStat = makeLambdaStat([]() { return (uint64_t)zinfo->phaseLength; });
+    lenStat->init("phaseLength", "Current phase length (cycles)");
+    ctrlStat->append(lenStat);
+    profGrows.init("grows", "Phases after which the length grew"); ctrlStat->append(&profGrows);
+    profShrinks.init("shrinks", "Phases after which the length shrank"); ctrlStat->append(&profShrinks);
+    profCrossings.init("crossings", "Crossing events produced in the bound phase"); ctrlStat->append(&profCrossings);
+    parentStat->append(ctrlStat);
+}
+
+void PhaseLengthController::update() {
+    uint64_t len = zinfo->phaseLength;
+
+    uint64_t crossings = zinfo->contentionSim->takePhaseCrossings();
+    profCrossings.inc(crossings);
+    uint64_t crossRate = crossings*1000/len;
+
+    uint64_t boundNs = zinfo->profSimTime->count(PROF_BOUND);
+    uint64_t weaveNs = zinfo->profSimTime->count(PROF_WEAVE);
+    uint64_t phaseBoundNs = boundNs - lastBoundNs;
+    uint64_t phaseWeaveNs = weaveNs - lastWeaveNs;
+    lastBoundNs = boundNs;
+    lastWeaveNs = weaveNs;
+    uint64_t syncPct = (phaseBoundNs + phaseWeaveNs)? 100*phaseWeaveNs/(phaseBoundNs + phaseWeaveNs) : 0;
+
+    uint32_t skewPct = zinfo->contentionSim->getWeaveSkew();
+
+    uint64_t newLen = len;
+    if (crossRate > crossingsHigh) {
+        newLen = MAX(len/2, (uint64_t)minLength);
+    } else if (crossRate < crossingsLow && (syncPct > syncHigh || skewPct > skewHigh)) {
+        newLen = MIN(len + MAX(len/4, (uint64_t)1), (uint64_t)maxLength);
+    }
+
+    if (newLen > len) profGrows.inc();
+    else if (newLen < len) profShrinks.inc();
+    zinfo->phaseLength = newLen;
+}
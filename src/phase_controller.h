@@ -0,0 +1,64 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHASE_CONTROLLER_H_
+#define PHASE_CONTROLLER_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "stats.h"
+
+/* Adapts zinfo->phaseLength between phases, within [minLength, maxLength].
+ *
+ * Phases that produce many crossing events per cycle (memory-heavy) are
+ * halved, since long phases let bound-phase latencies drift further from the
+ * contended ones. Phases with few crossings grow by 25% when synchronization
+ * is expensive, i.e., when the weave phase (during which every application
+ * thread waits at the barrier) takes a large fraction of wall time, or when
+ * weave threads are badly imbalanced, since longer phases amortize both.
+ */
+class PhaseLengthController : public GlobAlloc {
+    private:
+        const uint32_t minLength, maxLength;
+        const uint32_t crossingsHigh, crossingsLow;  // crossing events per 1000 cycles
+        const uint32_t syncHigh;  // % of wall time spent in the weave phase
+        const uint32_t skewHigh;  // % difference between the busiest and least busy weave thread
+
+        uint64_t lastBoundNs, lastWeaveNs;
+
+        Counter profGrows, profShrinks;
+        Counter profCrossings;
+
+    public:
+        PhaseLengthController(uint32_t _minLength, uint32_t _maxLength, uint32_t _crossingsHigh, uint32_t _crossingsLow,
+                uint32_t _syncHigh, uint32_t _skewHigh);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Called at the end of each phase, once globPhaseCycles has advanced and no thread is simulating
+        void update();
+};
+
+#endif  // PHASE_CONTROLLER_H_
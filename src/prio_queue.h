@@ -22,14 +22,28 @@
  * You should have received a copy of the GNU General Public License along with
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
-
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
+#include <stdint.h>
+#include "bithacks.h"
+#include "g_std/g_vector.h"
+#include "log.h"
 
+/* Hierarchical timing wheel.
+ *
+ * Level 0 holds the events of the current span of B 64-cycle blocks, with one
+ * bucket per cycle. Occupancy is summarized in two bitmap levels (one bit per
+ * block, one bit per 64 blocks), so finding the first event takes three ctz
+ * operations. Level 1 has 64 unsorted buckets, one per future span, and events
+ * beyond that sit in a single unsorted overflow list. When level 0 drains, the
+ * next populated level-1 bucket is cascaded into it. Far events are rare, so
+ * these never need a tree. Level-0 buckets are intrusive lists through T::next.
+ */
 template <typename T, uint32_t B>
 class PrioQueue {
+    static_assert(B % 64 == 0 && B <= 64*64, "B must be a multiple of 64, up to 4096");
+
     struct PQBlock {
         T* array[64];
         uint64_t occ; // bit i is 1 if array[i] is populated
@@ -60,18 +74,31 @@ class PrioQueue {
         }
     };
 
-    PQBlock blocks[B];
+    struct FarEvent { // far events keep their cycle alongside, as T has no public cycle
+        T* obj;
+        uint64_t cycle;
+    };
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
+    // Level 0
+    PQBlock blocks[B];
+    uint64_t blockOcc[B/64]; // bit i of word w is set if blocks[64*w + i] is populated
+    uint64_t wordOcc;        // bit w is set if blockOcc[w] != 0
 
-    FEMap feMap;
+    // Level 1 and overflow: unsorted, sorted out when cascaded
+    g_vector<FarEvent> spans[64]; // indexed by span % 64
+    uint64_t spanOcc;
+    g_vector<FarEvent> overflow;
 
-    uint64_t curBlock;
+    uint64_t curSpan;
+    uint64_t curBlock; // block of the last dequeue, only used to check enqueues
     uint64_t elems;
 
     public:
         PrioQueue() {
+            for (uint32_t i = 0; i < B/64; i++) blockOcc[i] = 0;
+            wordOcc = 0;
+            spanOcc = 0;
+            curSpan = 0;
             curBlock = 0;
             elems = 0;
         }
@@ -79,47 +106,35 @@ class PrioQueue {
         void enqueue(T* obj, uint64_t cycle) {
             uint64_t absBlock = cycle/64;
             assert(absBlock >= curBlock);
-
-            if (absBlock < curBlock + B) {
-                uint32_t i = absBlock % B;
-                uint32_t offset = cycle % 64;
-                blocks[i].enqueue(obj, offset);
-            } else {
+            uint64_t span = absBlock/B;
+            if (span == curSpan) {
+                enqueueNear(obj, cycle);
+            } else if (span < curSpan + 64) {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                spans[span % 64].push_back({obj, cycle});
+                spanOcc |= 1ul << (span % 64);
+            } else {
+                overflow.push_back({obj, cycle});
             }
             elems++;
         }
 
         T* dequeue(uint64_t& deqCycle) {
             assert(elems);
-            while (!blocks[curBlock % B].occ) {
-                curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
-            }
+            if (unlikely(!wordOcc)) cascade();
+            assert(wordOcc);
 
-            //We're now at the first populated block
+            uint32_t w = __builtin_ctzl(wordOcc);
+            uint32_t b = 64*w + __builtin_ctzl(blockOcc[w]);
             uint32_t offset;
-            T* obj = blocks[curBlock % B].dequeue(offset);
+            T* obj = blocks[b].dequeue(offset);
+            if (!blocks[b].occ) {
+                blockOcc[w] ^= 1ul << (b % 64);
+                if (!blockOcc[w]) wordOcc ^= 1ul << w;
+            }
             elems--;
 
+            curBlock = curSpan*B + b;
             deqCycle = curBlock*64 + offset;
             return obj;
         }
@@ -128,27 +143,88 @@ class PrioQueue {
             return elems;
         }
 
+        // Calls f(obj, cycle) on every queued element, level 0 first. Order is
+        // deterministic for a given sequence of operations, but not sorted
+        template <typename F>
+        void forEach(F f) const {
+            for (uint32_t b = 0; b < B; b++) {
+                if (!(blockOcc[b/64] & (1ul << (b % 64)))) continue;
+                for (uint32_t pos = 0; pos < 64; pos++) {
+                    for (T* obj = blocks[b].array[pos]; obj; obj = obj->next) f(obj, (curSpan*B + b)*64 + pos);
+                }
+            }
+            for (uint32_t i = 0; i < 64; i++) {
+                for (const FarEvent& fe : spans[(curSpan + 1 + i) % 64]) f(fe.obj, fe.cycle);
+            }
+            for (const FarEvent& fe : overflow) f(fe.obj, fe.cycle);
+        }
+
         inline uint64_t firstCycle() const {
             assert(elems);
-            for (uint32_t i = 0; i < B/2; i++) {
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
-                if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    return (curBlock + i)*64 + pos;
-                }
+            if (likely(wordOcc)) {
+                uint32_t w = __builtin_ctzl(wordOcc);
+                uint32_t b = 64*w + __builtin_ctzl(blockOcc[w]);
+                return (curSpan*B + b)*64 + __builtin_ctzl(blocks[b].occ);
             }
-            for (uint32_t i = B/2; i < B; i++) { //beyond B/2 blocks, there may be a far element that comes earlier
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
-                if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
-                }
+            // Level 0 is empty; the earliest event is in the first populated span
+            const g_vector<FarEvent>& fes = spanOcc? spans[nextSpan() % 64] : overflow;
+            assert(!fes.empty());
+            uint64_t minCycle = fes[0].cycle;
+            for (const FarEvent& fe : fes) minCycle = MIN(minCycle, fe.cycle);
+            return minCycle;
+        }
+
+    private:
+        inline void enqueueNear(T* obj, uint64_t cycle) {
+            uint32_t b = (cycle/64) % B;
+            blocks[b].enqueue(obj, cycle % 64);
+            blockOcc[b/64] |= 1ul << (b % 64);
+            wordOcc |= 1ul << (b/64);
+        }
+
+        // First populated level-1 span after curSpan; spanOcc must be nonzero
+        inline uint64_t nextSpan() const {
+            uint32_t s = (curSpan + 1) % 64;
+            uint64_t rot = (spanOcc >> s) | (s? (spanOcc << (64 - s)) : 0);
+            return curSpan + 1 + __builtin_ctzl(rot);
+        }
+
+        // Level 0 is empty: advance to the next populated span and move its events to level 0
+        void cascade() {
+            if (spanOcc) {
+                curSpan = nextSpan();
+            } else {
+                assert(!overflow.empty());
+                uint64_t minCycle = overflow[0].cycle;
+                for (const FarEvent& fe : overflow) minCycle = MIN(minCycle, fe.cycle);
+                curSpan = minCycle/64/B;
             }
 
-            return feMap.begin()->first;
+            g_vector<FarEvent>& fes = spans[curSpan % 64];
+            for (const FarEvent& fe : fes) {
+                assert(fe.cycle/64/B == curSpan);
+                enqueueNear(fe.obj, fe.cycle);
+            }
+            fes.clear();
+            spanOcc &= ~(1ul << (curSpan % 64));
+
+            // Overflow events that are now within the level-1 horizon
+            if (!overflow.empty()) {
+                uint32_t kept = 0;
+                for (const FarEvent& fe : overflow) {
+                    uint64_t span = fe.cycle/64/B;
+                    if (span == curSpan) {
+                        enqueueNear(fe.obj, fe.cycle);
+                    } else if (span < curSpan + 64) {
+                        spans[span % 64].push_back(fe);
+                        spanOcc |= 1ul << (span % 64);
+                    } else {
+                        overflow[kept++] = fe;
+                    }
+                }
+                overflow.resize(kept);
+            }
         }
 };
 
 #endif  // PRIO_QUEUE_H_
-
@@ -33,6 +33,12 @@
  * are garbage-collected once all their events are done. To do this without space
  * overheads, slabs are carefully aligned, so that objects inside the slab can
  * derive the pointer of their slab.
+ *
+ * Slab frees happen in the weave phase, concurrently from several contention
+ * simulation threads, while allocations happen in the bound phase from the
+ * owning thread. Freed slabs are pushed to a lock-free pending stack, and the
+ * owner splices the whole stack into its private freeList in bulk, either at
+ * the end of the phase (recycle()) or when it runs out of free slabs.
  */
 
 #include <deque>
@@ -55,12 +61,14 @@ class SlabAlloc;
 
 struct Slab {  // POD type (no constructor)
     SlabAlloc* allocator;
+    Slab* nextFree;  // links the allocator's pending-free stack
     volatile uint32_t liveElems;
     uint32_t usedBytes;
-    char buf[SLAB_SIZE - sizeof(SlabAlloc*) - sizeof(volatile uint32_t) - sizeof(uint32_t)];
+    char buf[SLAB_SIZE - 2*sizeof(void*) - sizeof(volatile uint32_t) - sizeof(uint32_t)];
 
     void init(SlabAlloc* _allocator) {
         allocator = _allocator;
+        nextFree = nullptr;
         clear();
     }
 
@@ -94,12 +102,16 @@ struct Slab {  // POD type (no constructor)
 class SlabAlloc {
     private:
         Slab* curSlab;
-        g_vector<Slab*> freeList;
+        g_vector<Slab*> freeList;  // only touched by the owner
         uint32_t liveSlabs;
-        mutex freeLock;  // used because slab frees may be concurrent
+        Slab* volatile pendingFree;  // slabs freed since the last recycle, pushed concurrently
+
+        // Profiling; slabReuses / slabAllocs is the pool hit rate
+        uint64_t slabAllocs;
+        uint64_t slabReuses;
 
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
+        SlabAlloc() : curSlab(nullptr), liveSlabs(0), pendingFree(nullptr), slabAllocs(0), slabReuses(0) {
             allocSlab();
         }
 
@@ -117,35 +129,57 @@ class SlabAlloc {
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
+        // Moves all slabs freed since the last call to the freeList. Must not
+        // race with alloc(); called at phase end, when the owner is stopped.
+        void recycle() {
+            Slab* s = __sync_lock_test_and_set(&pendingFree, nullptr);
+            while (s) {
+                Slab* next = s->nextFree;
+                s->nextFree = nullptr;
+                freeList.push_back(s);
+                assert(liveSlabs > 1);  // at least curSlab remains
+                liveSlabs--;
+                s = next;
+            }
+        }
+
+        uint64_t getSlabAllocs() const { return slabAllocs; }
+        uint64_t getSlabReuses() const { return slabReuses; }
+        uint32_t getLiveSlabs() const { return liveSlabs; }
+
     private:
         void allocSlab() {
-            scoped_mutex sm(freeLock);
+            if (freeList.empty()) recycle();
             if (!freeList.empty()) {
                 curSlab = freeList.back();
                 freeList.pop_back();
                 assert(curSlab);
+                slabReuses++;
             } else {
                 assert(sizeof(Slab) == SLAB_SIZE);
                 curSlab = gm_memalign<Slab>(sizeof(Slab));
                 assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
                 curSlab->init(this);  // NOTE: Slab is POD
             }
+            slabAllocs++;
             liveSlabs++;
             //info("allocated slab %p, %d live, %ld in freeList", curSlab, liveSlabs, freeList.size());
         }
 
         void freeSlab(Slab* s) {
-            scoped_mutex sm(freeLock);
             //info("freeing slab %p, %d live, %ld in freeList", s, liveSlabs, freeList.size());
             s->clear();
 #ifdef DEBUG_SLAB_ALLOC
             memset(s->buf, -1, sizeof(s->buf));
 #endif
             if (s != curSlab) {
-                freeList.push_back(s);
-                liveSlabs--;
+                // Lock-free push; the single consumer takes the whole stack at once, so there is no ABA
+                Slab* head;
+                do {
+                    head = pendingFree;
+                    s->nextFree = head;
+                } while (!__sync_bool_compare_and_swap(&pendingFree, head, s));
             }
-            assert(liveSlabs);  // at least curSlab
         }
 
         friend struct Slab;
@@ -23,95 +23,383 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to sort a trace. It reads in the trace sequntially until it
- * has seen at least one access from every thread, then dumps the sorted trace
- * out. This may consume large amounts of memory if traces are largely
- * imbalanced. A simple way to fix this would be to dump N separate traces,
- * then join them together --- that's more I/O though.
+/* Sorts an access trace by request cycle. Traces may not fit in memory, so
+ * this is an external merge sort: the trace is read in runs that fit in the
+ * memory budget, and worker threads radix-sort each run and write it to a
+ * temporary file while the next run is read. Runs are then k-way merged
+ * with large sequential reads, and streamed to the output trace. Both the
+ * sort and the merge are stable, so accesses with the same cycle keep their
+ * order in the input trace. Compressing HDF5 output chunks dominates the
+ * merge, so chunks are compressed on worker threads and written directly.
  */
 
+#include <chrono>
 #include <deque>
+#include <hdf5.h>
+#include <hdf5_hl.h>
 #include <queue>
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
 
 #include "access_tracing.h"
 #include "galloc.h"
 
 using namespace std;
 
-void printProgress(uint64_t read, uint64_t written, uint64_t total) {
-    printf("Read %3ld%% / Written %3ld%%\r", read*100/total, written*100/total);
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void printProgress(const char* phase, uint64_t done, uint64_t total) {
+    printf("%s %3ld%%\r", phase, total? done*100/total : 100);
     fflush(stdout);
 }
 
+static void printThroughput(const char* phase, uint64_t records, double secs) {
+    double mb = records*sizeof(PackedAccessRecord)/1e6;
+    info("%s: %ld records in %.2f s (%.2f Mrecords/s, %.1f MB/s)", phase, records, secs, records/1e6/secs, mb/secs);
+}
+
+// LSD radix sort on reqCycle, 16 bits per pass, skipping digits that are the same in all records.
+// Stable. Returns the sorted array, which is either recs or tmp.
+static PackedAccessRecord* radixSort(PackedAccessRecord* recs, PackedAccessRecord* tmp, uint64_t n) {
+    if (n == 0) return recs;
+    uint64_t varying = 0;  // bits that differ across records
+    bool sorted = true;  // traces are often nearly sorted already
+    for (uint64_t i = 1; i < n; i++) {
+        varying |= recs[i].reqCycle ^ recs[0].reqCycle;
+        sorted &= recs[i].reqCycle >= recs[i-1].reqCycle;
+    }
+    if (sorted) return recs;
+
+    vector<uint64_t> counts(1 << 16);
+    for (uint32_t shift = 0; shift < 64; shift += 16) {
+        if (((varying >> shift) & 0xffff) == 0) continue;
+        fill(counts.begin(), counts.end(), 0);
+        for (uint64_t i = 0; i < n; i++) counts[(recs[i].reqCycle >> shift) & 0xffff]++;
+        uint64_t pos = 0;
+        for (uint64_t& c : counts) {
+            uint64_t cur = c;
+            c = pos;
+            pos += cur;
+        }
+        for (uint64_t i = 0; i < n; i++) tmp[counts[(recs[i].reqCycle >> shift) & 0xffff]++] = recs[i];
+        swap(recs, tmp);
+    }
+    return recs;
+}
+
+static void sortRun(PackedAccessRecord* recs, PackedAccessRecord* tmp, uint64_t n, string runFile) {
+    PackedAccessRecord* sorted = radixSort(recs, tmp, n);
+    FILE* f = fopen(runFile.c_str(), "wb");
+    if (!f) panic("Could not open run file %s", runFile.c_str());
+    if (fwrite(sorted, sizeof(PackedAccessRecord), n, f) != n) panic("Could not write run file %s", runFile.c_str());
+    fclose(f);
+}
+
+// Reads a sorted run sequentially in large blocks
+class RunReader {
+    private:
+        FILE* f;
+        vector<PackedAccessRecord> buf;
+        uint64_t pos, len;
+        uint64_t left;  // records not read from the file yet
+
+    public:
+        RunReader(const string& runFile, uint64_t records, uint64_t bufRecords) : buf(bufRecords), pos(0), len(0), left(records) {
+            f = fopen(runFile.c_str(), "rb");
+            if (!f) panic("Could not open run file %s", runFile.c_str());
+            refill();
+        }
+
+        ~RunReader() {
+            fclose(f);
+        }
+
+        inline bool empty() const {return pos == len;}
+        inline const PackedAccessRecord& head() const {return buf[pos];}
+
+        inline void pop() {
+            if (++pos == len) refill();
+        }
+
+    private:
+        void refill() {
+            pos = 0;
+            len = min(left, (uint64_t)buf.size());
+            if (fread(&buf[0], sizeof(PackedAccessRecord), len, f) != len) panic("Short read on run file");
+            left -= len;
+        }
+};
+
+/* Writes an HDF5 trace chunk by chunk, applying the dataset's shuffle and
+ * deflate filters on worker threads instead of in H5PTappend, which
+ * compresses serially. Chunks in flight are limited to the memory budget.
+ */
+class ParallelTraceOutput {
+    private:
+        struct Chunk {
+            vector<PackedAccessRecord> recs;
+            vector<uint8_t> shuffled;
+            vector<uint8_t> compressed;
+            uLongf compBytes;
+            uint64_t numRecords;
+            uint64_t idx;
+        };
+
+        hid_t fid, dset;
+        uint64_t chunkRecords;
+        int level;
+        uint32_t numThreads;
+        vector<Chunk*> freeChunks;
+        deque<pair<thread, Chunk*>> compressing;
+        Chunk* cur;
+        uint64_t numChunks;
+
+    public:
+        ParallelTraceOutput(const char* fname, uint32_t numChildren, uint32_t _numThreads, uint64_t maxBytes) : numThreads(_numThreads), numChunks(0) {
+            CreateHDF5Trace(fname, numChildren);
+            fid = H5Fopen(fname, H5F_ACC_RDWR, H5P_DEFAULT);
+            if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname);
+            dset = H5Dopen2(fid, "accs", H5P_DEFAULT);
+            if (dset == H5I_INVALID_HID) panic("Could not open HDF5 dataset");
+
+            hid_t plist = H5Dget_create_plist(dset);
+            hsize_t dims[1];
+            H5Pget_chunk(plist, 1, dims);
+            chunkRecords = dims[0];
+            if (H5Pget_nfilters(plist) != 2 || H5Pget_filter2(plist, 0, nullptr, nullptr, nullptr, 0, nullptr, nullptr) != H5Z_FILTER_SHUFFLE) {
+                panic("Unexpected filters in trace dataset");
+            }
+            unsigned int cdValues[1];
+            size_t cdElems = 1;
+            if (H5Pget_filter2(plist, 1, nullptr, &cdElems, cdValues, 0, nullptr, nullptr) != H5Z_FILTER_DEFLATE) panic("Unexpected filters in trace dataset");
+            level = cdValues[0];
+            H5Pclose(plist);
+
+            // Each chunk buffers its records, their shuffled bytes, and the compressed output; keep at least two so
+            // that one is filled while another is compressed
+            uint32_t maxChunks = max(maxBytes/chunkBytes(chunkRecords), 2ul);
+            uint32_t poolChunks = min(numThreads + 1, maxChunks);
+            for (uint32_t i = 0; i < poolChunks; i++) {
+                Chunk* c = new Chunk();
+                c->recs.resize(chunkRecords);
+                c->shuffled.resize(chunkRecords*sizeof(PackedAccessRecord));
+                c->compressed.resize(compressBound(chunkRecords*sizeof(PackedAccessRecord)));
+                freeChunks.push_back(c);
+            }
+            cur = nextChunk();
+        }
+
+        ~ParallelTraceOutput() {
+            assert(compressing.empty());  // call finish() first
+            for (Chunk* c : freeChunks) delete c;
+        }
+
+        static uint64_t chunkBytes(uint64_t records) {
+            return 2*records*sizeof(PackedAccessRecord) + compressBound(records*sizeof(PackedAccessRecord));
+        }
+
+        uint64_t bufferBytes() const {
+            return (freeChunks.size() + 1)*chunkBytes(chunkRecords);
+        }
+
+        inline void write(const PackedAccessRecord& rec) {
+            cur->recs[cur->numRecords++] = rec;
+            if (cur->numRecords == chunkRecords) {
+                submit(cur);
+                cur = nextChunk();
+            }
+        }
+
+        void finish() {
+            if (cur->numRecords) submit(cur);
+            else freeChunks.push_back(cur);
+            while (!compressing.empty()) writeOldest();
+            hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+            uint32_t finished = 1;
+            H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
+            H5Aclose(fAttr);
+            H5Dclose(dset);
+            H5Fclose(fid);
+        }
+
+    private:
+        Chunk* nextChunk() {
+            if (freeChunks.empty()) writeOldest();
+            Chunk* c = freeChunks.back();
+            freeChunks.pop_back();
+            c->numRecords = 0;
+            c->idx = numChunks++;
+            return c;
+        }
+
+        void submit(Chunk* c) {
+            // HDF5 stores edge chunks whole, so pad them
+            memset(&c->recs[c->numRecords], 0, (chunkRecords - c->numRecords)*sizeof(PackedAccessRecord));
+            compressing.push_back(make_pair(thread(compress, c, level), c));
+        }
+
+        static void compress(Chunk* c, int level) {
+            // Shuffle filter: byte j of every record goes to the j-th plane
+            const uint8_t* src = (const uint8_t*) &c->recs[0];
+            uint64_t n = c->recs.size();
+            for (uint32_t j = 0; j < sizeof(PackedAccessRecord); j++) {
+                uint8_t* dst = &c->shuffled[j*n];
+                for (uint64_t i = 0; i < n; i++) dst[i] = src[i*sizeof(PackedAccessRecord) + j];
+            }
+            c->compBytes = c->compressed.size();
+            if (compress2(&c->compressed[0], &c->compBytes, &c->shuffled[0], c->shuffled.size(), level) != Z_OK) panic("Chunk compression failed");
+        }
+
+        // Chunks are written in order, extending the dataset as they go
+        void writeOldest() {
+            Chunk* c = compressing.front().second;
+            compressing.front().first.join();
+            compressing.pop_front();
+            hsize_t offset[1] = {c->idx*chunkRecords};
+            hsize_t size[1] = {offset[0] + c->numRecords};
+            if (H5Dset_extent(dset, size) < 0) panic("Could not extend trace dataset");
+            if (H5DOwrite_chunk(dset, H5P_DEFAULT, 0 /*all filters applied*/, offset, c->compBytes, &c->compressed[0]) < 0) panic("Could not write trace chunk");
+            freeChunks.push_back(c);
+        }
+};
+
 int main(int argc, const char* argv[]) {
     InitLog(""); //no log header
-    if (argc != 3) {
+    if (argc < 3 || argc > 6) {
         info("Sorts an access trace");
-        info("Usage: %s <input_trace> <output_trace>", argv[0]);
+        info("Usage: %s <input_trace> <output_trace> [threads] [memory_MB] [tmp_dir]", argv[0]);
+        info("  threads: sorting threads (default: all cores)");
+        info("  memory_MB: memory budget for runs, merge and output buffers (default: 2048)");
+        info("  tmp_dir: where sorted runs are written (default: output trace directory)");
         exit(1);
     }
 
+    uint32_t numThreads = (argc > 3)? strtoul(argv[3], nullptr, 0) : thread::hardware_concurrency();
+    numThreads = max(numThreads, 1u);
+    uint64_t memBytes = ((argc > 4)? strtoul(argv[4], nullptr, 0) : 2048ul) << 20;
+    string outFile = argv[2];
+    string tmpDir = (argc > 5)? argv[5] : ((outFile.rfind('/') == string::npos)? "." : outFile.substr(0, outFile.rfind('/')));
+
     gm_init(32<<20 /*32 MB --- should be enough*/);
 
     AccessTraceReader* tr = new AccessTraceReader(argv[1]);
     uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
-
-    deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
-    for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
-    priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
-    uint64_t readRecords  = 0;
-    uint64_t writtenRecords  = 0;
-    uint64_t totalRecords  = tr->getNumRecords();
-    info("Sorting %ld records", totalRecords);
-
-    while (!tr->empty() || heads.size() > 0) {
-        if (!tr->empty() && heads.size() < numChildren) { //Read trace until all heads are filled
-            for (uint32_t i = 0; i < 1024; i++) { //For performance, read at least a few accesses
-                AccessRecord acc = tr->read();
-                readRecords++;
-                if ((readRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-                if (!accs[acc.childId]) {
-                    accs[acc.childId] = new deque<AccessRecord>();
-                    heads.push(make_pair(-acc.reqCycle, acc.childId));
-                }
-                accs[acc.childId]->push_back(acc);
-                if (tr->empty()) break;
-            }
+    uint64_t totalRecords = tr->getNumRecords();
+
+    // Each slot holds a run and its radix sort scratch space; one slot is filled while the others are sorted
+    uint32_t numSlots = numThreads + 1;
+    uint64_t runRecords = max(memBytes/(2*numSlots*sizeof(PackedAccessRecord)), 1024ul);
+    numSlots = min((uint64_t)numSlots, (totalRecords + runRecords - 1)/runRecords + 1);
+    info("Sorting %ld records, %d threads, runs of up to %ld records", totalRecords, numThreads, runRecords);
+
+    // Phase 1: sorted runs
+    auto start = chrono::steady_clock::now();
+    vector<PackedAccessRecord*> slots(numSlots);
+    for (PackedAccessRecord*& s : slots) s = new PackedAccessRecord[2*runRecords];
+    deque<pair<thread, uint32_t>> sorting;  // (worker, slot)
+    vector<uint32_t> freeSlots;
+    for (uint32_t s = 0; s < numSlots; s++) freeSlots.push_back(s);
+    vector<string> runFiles;
+    vector<uint64_t> runSizes;
+    uint64_t readRecords = 0;
+
+    while (!tr->empty()) {
+        if (freeSlots.empty()) {
+            sorting.front().first.join();
+            freeSlots.push_back(sorting.front().second);
+            sorting.pop_front();
+        }
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        PackedAccessRecord* recs = slots[slot];
+        uint64_t n = 0;
+        while (n < runRecords && !tr->empty()) {
+            AccessRecord acc = tr->read();
+            recs[n++] = {acc.lineAddr, acc.reqCycle, acc.latency, (uint16_t) acc.childId, (uint16_t) acc.type};
         }
+        readRecords += n;
+        printProgress("Sorting runs", readRecords, totalRecords);
 
-        assert(heads.size() <= numChildren);
+        string runFile = tmpDir + "/sorttrace." + to_string(getpid()) + "." + to_string(runFiles.size()) + ".run";
+        runFiles.push_back(runFile);
+        runSizes.push_back(n);
+        sorting.push_back(make_pair(thread(sortRun, recs, recs + runRecords, n, runFile), slot));
+    }
+    while (!sorting.empty()) {
+        sorting.front().first.join();
+        sorting.pop_front();
+    }
+    for (PackedAccessRecord* s : slots) delete[] s;
+    delete tr;
+    printf("\n");
+    double runSecs = secondsSince(start);
+    printThroughput("Run generation", readRecords, runSecs);
+    if (readRecords != totalRecords) panic("Read %ld records, trace has %ld", readRecords, totalRecords);
 
-        while (heads.size() == numChildren || (tr->empty() && heads.size() > 0)) {
-            pair<int64_t, uint32_t> next = heads.top();
-            //info("pre %ld %d %ld", heads.size(), next.second, next.first);
-            heads.pop();
-            //info("post %ld %d %ld", heads.size(), heads.top().second, heads.top().first);
-            uint32_t child = next.second;
-            assert(!accs[child]->empty());
-            AccessRecord acc = accs[child]->front();
-            accs[child]->pop_front();
-            tw->write(acc);
-            writtenRecords++;
-            if ((writtenRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-            if (accs[child]->empty()) {
-                delete accs[child];
-                accs[child] = nullptr;
+    // Phase 2: k-way merge, streamed to the output trace
+    auto mergeStart = chrono::steady_clock::now();
+    uint32_t numRuns = runFiles.size();
+    bool native = IsNativeTraceName(outFile.c_str());
+    AccessTraceWriter* tw = native? new AccessTraceWriter(outFile.c_str(), numChildren) : nullptr;
+    // Output chunks take up to half the budget, and the run buffers get the rest
+    ParallelTraceOutput* pto = native? nullptr : new ParallelTraceOutput(outFile.c_str(), numChildren, numThreads, memBytes/2);
+    uint64_t outBytes = native? memBytes/(numRuns + 1) : pto->bufferBytes();
+    uint64_t bufRecords = max((memBytes - min(outBytes, memBytes))/(max(numRuns, 1u)*sizeof(PackedAccessRecord)), 4096ul);
+    vector<RunReader*> runs(numRuns);
+    priority_queue<pair<uint64_t, uint32_t>, vector<pair<uint64_t, uint32_t>>, greater<pair<uint64_t, uint32_t>>> heads;  // (cycle, run), ties go to the earlier run
+    for (uint32_t r = 0; r < numRuns; r++) {
+        runs[r] = new RunReader(runFiles[r], runSizes[r], bufRecords);
+        if (!runs[r]->empty()) heads.push(make_pair(runs[r]->head().reqCycle, r));
+    }
+
+    uint64_t writtenRecords = 0;
+    uint64_t nextProgress = 0;
+    while (!heads.empty()) {
+        uint32_t r = heads.top().second;
+        heads.pop();
+        RunReader* run = runs[r];
+        // Stream from this run while it stays ahead of the others
+        pair<uint64_t, uint32_t> limit = heads.empty()? make_pair((uint64_t)-1, numRuns) : heads.top();
+        do {
+            const PackedAccessRecord& pr = run->head();
+            if (native) {
+                AccessRecord acc = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+                tw->write(acc);
             } else {
-                AccessRecord acc = accs[child]->front();
-                heads.push(make_pair(-acc.reqCycle, acc.childId));
+                pto->write(pr);
             }
+            run->pop();
+            writtenRecords++;
+        } while (!run->empty() && make_pair(run->head().reqCycle, r) < limit);
+        if (!run->empty()) heads.push(make_pair(run->head().reqCycle, r));
+        if (writtenRecords >= nextProgress) {
+            printProgress("Merging", writtenRecords, totalRecords);
+            nextProgress = writtenRecords + (1 << 20);
         }
     }
-    printProgress(readRecords, writtenRecords, totalRecords);
+    if (native) {
+        tw->dump(false); //flushes it
+        delete tw;
+    } else {
+        pto->finish();
+        delete pto;
+    }
+    printProgress("Merging", writtenRecords, totalRecords);
     printf("\n");
-    assert(readRecords == writtenRecords);
-    assert(readRecords == totalRecords);
 
-    delete tr;
-    tw->dump(false); //flushes it
-    delete tw;
+    for (uint32_t r = 0; r < numRuns; r++) {
+        delete runs[r];
+        unlink(runFiles[r].c_str());
+    }
+    assert(writtenRecords == totalRecords);
+    printThroughput("Merge", writtenRecords, secondsSince(mergeStart));
+    printThroughput("Total", writtenRecords, secondsSince(start));
     return 0;
 }
-
@@ -29,6 +29,9 @@
  *
  * There are four basic types of stats:
  * - Counter: A plain single counter.
+ * - ShardedCounter: A counter split in per-host-CPU padded slots, summed
+ *   when read. Use it instead of Counter in objects that many simulation
+ *   threads update concurrently (e.g., memory controllers).
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
  * - Histogram: A GEMS-style histogram, intended to profile a distribution.
@@ -45,6 +48,10 @@
  *   or for efficiency reasons (e.g. the per-thread phase cycles count is
  *   updated on every BBL, and may be an uint32_t)
  *
+ * Counters and vector counters can optionally keep their values in a
+ * per-owner StatArena instead (ArenaCounter, ArenaVectorCounter; see
+ * stats_arena.h), which makes snapshots of the stat tree cheap.
+ *
  * Groups of stats are contained in aggregates (AggregateStat), representing
  * a collection of stats. At initialization time, all stats are registered
  * with an aggregate, forming a tree of stats. After all stats are
@@ -74,10 +81,14 @@
 
 /* TODO: I want these to be POD types, but polymorphism (needed by dynamic_cast) probably disables it. Dang. */
 
+#include <sched.h>
 #include <stdint.h>
 #include <string>
+#include <string.h>
+#include <unistd.h>
 #include "g_std/g_vector.h"
 #include "log.h"
+#include "pad.h"
 
 class Stat : public GlobAlloc {
     protected:
@@ -186,6 +197,9 @@ class ScalarStat : public Stat {
         }
 
         virtual uint64_t get() const = 0;
+
+        // Address of the value if it is plain memory (e.g., a counter), or nullptr if get() must compute it
+        virtual const uint64_t* storage() const {return nullptr;}
 };
 
 class VectorStat : public Stat {
@@ -198,6 +212,9 @@ class VectorStat : public Stat {
         virtual uint64_t count(uint32_t idx) const = 0;
         virtual uint32_t size() const = 0;
 
+        // Address of the size() contiguous values if they are plain memory, or nullptr if count() must compute them
+        virtual const uint64_t* storage() const {return nullptr;}
+
         inline bool hasCounterNames() {
             return (_counterNames != nullptr);
         }
@@ -247,6 +264,73 @@ class Counter : public ScalarStat {
         inline void set(uint64_t data) {
             _count = data;
         }
+
+        const uint64_t* storage() const {
+            return &_count;
+        }
+};
+
+/* Counter for shared objects updated by many host threads at once. A plain
+ * Counter either races or bounces its cacheline between them; instead, each
+ * host CPU increments its own cacheline-padded slot, and get() sums the slots
+ * (reads are rare, at dumps). Slots are picked with sched_getcpu(), which,
+ * unlike thread ids, is consistent across zsim's processes and needs no TLS
+ * (which Pin tools can't rely on). Threads may migrate mid-update, so slots
+ * are updated atomically, but a slot's line stays in its CPU's cache.
+ */
+class ShardedCounter : public ScalarStat {
+    private:
+        static const uint32_t MAX_SHARDS = 64;
+        static const uint32_t SLOT_WORDS = CACHE_LINE_BYTES/sizeof(uint64_t);
+
+        uint64_t* _slots;
+        uint32_t _shardMask;
+
+        inline uint64_t* slot() {
+            return &_slots[((uint32_t)sched_getcpu() & _shardMask)*SLOT_WORDS];
+        }
+
+    public:
+        ShardedCounter() : ScalarStat(), _slots(nullptr), _shardMask(0) {}
+
+        void init(const char* name, const char* desc) {
+            initStat(name, desc);
+            uint32_t cpus = sysconf(_SC_NPROCESSORS_CONF);
+            uint32_t shards = 1;
+            while (shards < cpus && shards < MAX_SHARDS) shards *= 2;
+            _shardMask = shards - 1;
+            _slots = gm_memalign<uint64_t>(CACHE_LINE_BYTES, shards*SLOT_WORDS);
+            memset(_slots, 0, shards*SLOT_WORDS*sizeof(uint64_t));
+        }
+
+        inline void inc(uint64_t delta) {
+            __sync_fetch_and_add(slot(), delta);
+        }
+
+        inline void inc() {
+            __sync_fetch_and_add(slot(), 1);
+        }
+
+        // Updates are always atomic; kept for compatibility with Counter
+        inline void atomicInc(uint64_t delta) {
+            inc(delta);
+        }
+
+        inline void atomicInc() {
+            inc();
+        }
+
+        uint64_t get() const {
+            uint64_t res = 0;
+            for (uint32_t i = 0; i <= _shardMask; i++) res += _slots[i*SLOT_WORDS];
+            return res;
+        }
+
+        // Not atomic with respect to concurrent increments
+        inline void set(uint64_t data) {
+            for (uint32_t i = 0; i <= _shardMask; i++) _slots[i*SLOT_WORDS] = 0;
+            _slots[0] = data;
+        }
 };
 
 class VectorCounter : public VectorStat {
@@ -296,6 +380,10 @@ class VectorCounter : public VectorStat {
         inline uint32_t size() const {
             return _counters.size();
         }
+
+        const uint64_t* storage() const {
+            return &_counters[0];
+        }
 };
 
 /*
@@ -404,6 +492,19 @@ class TextBackend : public StatsBackend {
 };
 
 
+class LiveBackendImpl;
+
+// Publishes stats to a shared-memory ring for live monitoring; see live_stats.h
+class LiveBackend : public StatsBackend {
+    private:
+        LiveBackendImpl* backend;
+
+    public:
+        LiveBackend(const char* filename, AggregateStat* rootStat, uint32_t numFrames, const char* label, uint32_t pid, bool keep);
+        virtual void dump(bool buffered);
+};
+
+
 class HDF5BackendImpl;
 
 class HDF5Backend : public StatsBackend {
@@ -413,6 +514,14 @@ class HDF5Backend : public StatsBackend {
     public:
         HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates);
         virtual void dump(bool buffered);
+
+        // Async mode: dumps just snapshot stats, and a thread running writerLoop() aggregates and writes them.
+        // Call initAsync() before the first dump.
+        void initAsync(size_t bytesPerWrite);
+        void writerLoop();
+        static void WriterThreadTrampoline(void* arg) {
+            static_cast<HDF5Backend*>(arg)->writerLoop();
+        }
 };
 
 #endif  // STATS_H_
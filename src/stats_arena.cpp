@@ -0,0 +1,73 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats_arena.h"
+
+FlatStats::FlatStats(Stat* root, bool _skipVectors) : words(0), skipVectors(_skipVectors) {
+    walk(root);
+    info("FlatStats: %d values in %ld runs", words, runs.size());
+}
+
+void FlatStats::walk(Stat* s) {
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) walk(as->get(i));
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        addRun({ss->storage(), 1, ss, nullptr});
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        if (!skipVectors) addRun({vs->storage(), vs->size(), nullptr, vs});
+    } else {
+        panic("Unrecognized stat type");
+    }
+}
+
+void FlatStats::addRun(const Run& r) {
+    words += r.words;
+    // Coalesce with the previous run if the values are adjacent in memory (e.g., consecutive stats of an arena)
+    if (r.src && !runs.empty()) {
+        Run& last = runs.back();
+        if (last.src && last.src + last.words == r.src) {
+            last.words += r.words;
+            return;
+        }
+    }
+    runs.push_back(r);
+}
+
+void FlatStats::snapshot(uint64_t* dst) const {
+    for (const Run& r : runs) {
+        if (r.src) {
+            memcpy(dst, r.src, r.words*sizeof(uint64_t));
+        } else if (r.scalar) {
+            *dst = r.scalar->get();
+        } else {
+            for (uint32_t i = 0; i < r.words; i++) dst[i] = r.vector->count(i);
+        }
+        dst += r.words;
+    }
+}
+
+void FlatStats::diff(const uint64_t* __restrict__ cur, const uint64_t* __restrict__ prev, uint64_t* __restrict__ out, uint32_t words) {
+    for (uint32_t i = 0; i < words; i++) out[i] = cur[i] - prev[i];
+}
@@ -0,0 +1,209 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_ARENA_H_
+#define STATS_ARENA_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "log.h"
+#include "pad.h"
+#include "stats.h"
+
+/* Counter arenas. Each Counter keeps its value inside its own object, so the
+ * counters of an owner end up scattered over the heap, interleaved with
+ * names, descriptions and vtable pointers, and reading them takes a virtual
+ * call each. ArenaCounter and ArenaVectorCounter have the same interface as
+ * Counter and VectorCounter, but keep their values in a StatArena shared by
+ * all the stats of an owner (e.g., a cache or a memory controller), packed
+ * back to back in init order. Arenas are cacheline-aligned and padded, so
+ * different owners never share lines.
+ *
+ * FlatStats flattens a stat tree once and coalesces stats whose values are
+ * adjacent in memory into runs, so a snapshot of arena-backed stats takes a
+ * memcpy per arena. Snapshots can be diffed with a vectorized subtraction.
+ */
+
+class StatArena : public GlobAlloc {
+    private:
+        uint64_t* base;
+        uint32_t capacity; //in words, a multiple of a cache line
+        uint32_t used;
+
+    public:
+        // Arenas can't grow (that would move the counters), so size them for all the owner's counters
+        explicit StatArena(uint32_t words) : used(0) {
+            assert(words);
+            const uint32_t lineWords = CACHE_LINE_BYTES/sizeof(uint64_t);
+            capacity = (words + lineWords - 1)/lineWords*lineWords;
+            base = gm_memalign<uint64_t>(CACHE_LINE_BYTES, capacity);
+            memset(base, 0, capacity*sizeof(uint64_t));
+        }
+
+        uint64_t* alloc(uint32_t words) {
+            if (used + words > capacity) panic("StatArena: out of space (%d words, %d used, %d requested)", capacity, used, words);
+            uint64_t* res = base + used;
+            used += words;
+            return res;
+        }
+
+        const uint64_t* data() const {return base;}
+        uint32_t size() const {return used;}
+
+        void snapshot(uint64_t* dst) const {
+            memcpy(dst, base, used*sizeof(uint64_t));
+        }
+};
+
+class ArenaCounter : public ScalarStat {
+    private:
+        uint64_t* _count;
+
+    public:
+        ArenaCounter() : ScalarStat(), _count(nullptr) {}
+
+        void init(const char* name, const char* desc, StatArena* arena) {
+            initStat(name, desc);
+            _count = arena->alloc(1);
+            *_count = 0;
+        }
+
+        inline void inc(uint64_t delta) {
+            *_count += delta;
+        }
+
+        inline void inc() {
+            (*_count)++;
+        }
+
+        inline void atomicInc(uint64_t delta) {
+            __sync_fetch_and_add(_count, delta);
+        }
+
+        inline void atomicInc() {
+            __sync_fetch_and_add(_count, 1);
+        }
+
+        uint64_t get() const {
+            return *_count;
+        }
+
+        inline void set(uint64_t data) {
+            *_count = data;
+        }
+
+        const uint64_t* storage() const {
+            return _count;
+        }
+};
+
+class ArenaVectorCounter : public VectorStat {
+    private:
+        uint64_t* _counters;
+        uint32_t _size;
+
+    public:
+        ArenaVectorCounter() : VectorStat(), _counters(nullptr), _size(0) {}
+
+        /* Without counter names */
+        void init(const char* name, const char* desc, StatArena* arena, uint32_t size) {
+            initStat(name, desc);
+            assert(size > 0);
+            _counters = arena->alloc(size);
+            _size = size;
+            for (uint32_t i = 0; i < size; i++) _counters[i] = 0;
+            _counterNames = nullptr;
+        }
+
+        /* With counter names */
+        void init(const char* name, const char* desc, StatArena* arena, uint32_t size, const char** counterNames) {
+            init(name, desc, arena, size);
+            assert(counterNames);
+            _counterNames = gm_dup<const char*>(counterNames, size);
+        }
+
+        inline void inc(uint32_t idx, uint64_t value) {
+            _counters[idx] += value;
+        }
+
+        inline void inc(uint32_t idx) {
+            _counters[idx]++;
+        }
+
+        inline void atomicInc(uint32_t idx, uint64_t delta) {
+            __sync_fetch_and_add(&_counters[idx], delta);
+        }
+
+        inline void atomicInc(uint32_t idx) {
+            __sync_fetch_and_add(&_counters[idx], 1);
+        }
+
+        inline uint64_t count(uint32_t idx) const {
+            return _counters[idx];
+        }
+
+        inline uint32_t size() const {
+            return _size;
+        }
+
+        const uint64_t* storage() const {
+            return _counters;
+        }
+};
+
+/* Flattened, immutable view of the leaf values of a stat tree, in inorder
+ * walk order (the order the HDF5 backend dumps them in). Build it after the
+ * tree is made immutable.
+ */
+class FlatStats : public GlobAlloc {
+    private:
+        struct Run {
+            const uint64_t* src; //plain memory; if null, read through the stat
+            uint32_t words;
+            ScalarStat* scalar;
+            VectorStat* vector;
+        };
+        g_vector<Run> runs;
+        uint32_t words;
+        bool skipVectors;
+
+        void walk(Stat* s);
+        void addRun(const Run& r);
+
+    public:
+        explicit FlatStats(Stat* root, bool _skipVectors = false);
+
+        uint32_t size() const {return words;} //values per snapshot
+        uint32_t numRuns() const {return runs.size();}
+
+        void snapshot(uint64_t* dst) const;
+
+        // out[i] = cur[i] - prev[i]. Buffers must not overlap, which lets the compiler vectorize it.
+        static void diff(const uint64_t* __restrict__ cur, const uint64_t* __restrict__ prev, uint64_t* __restrict__ out, uint32_t words);
+};
+
+#endif  // STATS_ARENA_H_
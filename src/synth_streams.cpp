@@ -0,0 +1,141 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "synth_streams.h"
+#include <algorithm>
+#include <math.h>
+#include "bithacks.h"
+#include "config.h"
+#include "log.h"
+
+StrideStream::StrideStream(uint64_t _footprintLines, uint64_t _stride, uint64_t _gap, double _writeFraction, uint64_t seed)
+    : SynthStream(_gap, _writeFraction, seed), footprintLines(_footprintLines), stride(_stride), pos(0), base(0)
+{
+    if (stride == 0 || stride >= footprintLines) panic("Stride (%ld lines) must be in [1, footprint)", stride);
+}
+
+Address StrideStream::nextLine() {
+    Address line = pos;
+    pos += stride;
+    if (pos >= footprintLines) {  // next pass starts one line over, so all lines get touched
+        base = (base + 1) % stride;
+        pos = base;
+    }
+    return line;
+}
+
+ZipfStream::ZipfStream(uint64_t _numPages, uint64_t _pageLines, double alpha, uint64_t _driftPages, uint64_t _driftRequests,
+        uint64_t _gap, double _writeFraction, uint64_t seed)
+    : SynthStream(_gap, _writeFraction, seed), numPages(_numPages), pageLines(_pageLines),
+      driftPages(_driftPages), driftRequests(_driftRequests), drift(0), requests(0)
+{
+    cdf.resize(numPages);
+    double sum = 0.0;
+    for (uint64_t r = 0; r < numPages; r++) {
+        sum += 1.0/pow(r + 1, alpha);
+        cdf[r] = sum;
+    }
+    for (double& c : cdf) c /= sum;
+    pageOfRank.resize(numPages);
+    for (uint64_t p = 0; p < numPages; p++) pageOfRank[p] = p;
+    std::shuffle(pageOfRank.begin(), pageOfRank.end(), rng);
+}
+
+Address ZipfStream::nextLine() {
+    if (driftRequests && ++requests == driftRequests) {
+        drift += driftPages;
+        requests = 0;
+    }
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    uint64_t page = (pageOfRank[MIN(rank, numPages - 1)] + drift) % numPages;
+    return page*pageLines + random(pageLines);
+}
+
+PhaseStream::PhaseStream(uint64_t _numPages, uint64_t _pageLines, uint64_t _hotPages, double _hotFraction, uint64_t _phaseRequests,
+        uint64_t _gap, double _writeFraction, uint64_t seed)
+    : SynthStream(_gap, _writeFraction, seed), numPages(_numPages), pageLines(_pageLines), hotPages(_hotPages),
+      hotFraction(_hotFraction), phaseRequests(_phaseRequests), requests(0)
+{
+    if (hotPages == 0 || hotPages > numPages) panic("Hot set (%ld pages) must be in [1, %ld]", hotPages, numPages);
+    hotBase = random(numPages);
+}
+
+Address PhaseStream::nextLine() {
+    if (phaseRequests && ++requests == phaseRequests) {
+        hotBase = random(numPages);
+        requests = 0;
+    }
+    bool hot = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < hotFraction;
+    uint64_t page = hot? (hotBase + random(hotPages)) % numPages : random(numPages);
+    return page*pageLines + random(pageLines);
+}
+
+PointerChaseStream::PointerChaseStream(uint64_t footprintLines, uint64_t _gap, double _writeFraction, uint64_t seed)
+    : SynthStream(_gap, _writeFraction, seed), cur(0)
+{
+    if (footprintLines < 2 || footprintLines > (1ul << 32)) panic("Pointer chase footprint (%ld lines) must be in [2, 2^32]", footprintLines);
+    // Sattolo's algorithm: a random permutation with a single cycle, so every line is visited
+    succ.resize(footprintLines);
+    for (uint64_t i = 0; i < footprintLines; i++) succ[i] = i;
+    for (uint64_t i = footprintLines - 1; i > 0; i--) std::swap(succ[i], succ[random(i)]);
+}
+
+Address PointerChaseStream::nextLine() {
+    cur = succ[cur];
+    return cur;
+}
+
+SynthStream* BuildSynthStream(Config& config, const std::string& pattern, uint32_t lineSize) {
+    uint64_t footprintLines = (((uint64_t)config.get<uint32_t>("synth.footprintMB", 1024)) << 20)/lineSize;
+    uint64_t pageLines = config.get<uint32_t>("synth.pageSize", 4096)/lineSize;
+    uint64_t numPages = footprintLines/pageLines;
+    uint64_t gap = config.get<uint32_t>("synth.gap", 20);  // cycles between requests
+    double writeFraction = config.get<double>("synth.writeFraction", 0.3);
+    uint64_t seed = config.get<uint32_t>("synth.seed", 1);
+    if (pageLines == 0 || numPages == 0) panic("Invalid synth.footprintMB / synth.pageSize");
+
+    if (pattern == "stream") {
+        return new StrideStream(footprintLines, 1, gap, writeFraction, seed);
+    } else if (pattern == "stride") {
+        return new StrideStream(footprintLines, config.get<uint32_t>("synth.stride", pageLines), gap, writeFraction, seed);
+    } else if (pattern == "zipf") {
+        return new ZipfStream(numPages, pageLines,
+                config.get<double>("synth.zipfAlpha", 0.99),
+                config.get<uint32_t>("synth.driftPages", 1024), // hot pages shift by this much...
+                config.get<uint32_t>("synth.driftRequests", 100000), // ...every this many requests (0 = no drift)
+                gap, writeFraction, seed);
+    } else if (pattern == "phases") {
+        return new PhaseStream(numPages, pageLines,
+                config.get<uint32_t>("synth.hotPages", MAX(numPages/16, 1ul)),
+                config.get<double>("synth.hotFraction", 0.9),
+                config.get<uint32_t>("synth.phaseRequests", 1000000),
+                gap, writeFraction, seed);
+    } else if (pattern == "chase") {
+        return new PointerChaseStream(footprintLines, gap, writeFraction, seed);
+    } else {
+        panic("Invalid synthetic pattern %s (valid: stream, stride, zipf, phases, chase)", pattern.c_str());
+    }
+}
@@ -0,0 +1,158 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTH_STREAMS_H_
+#define SYNTH_STREAMS_H_
+
+#include <random>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mem_trace.h"
+
+class Config;
+
+/* Synthetic memory request streams, to benchmark memory controllers without
+ * Pin or traces. They produce the same records as MemTraceReader, and are
+ * deterministic for a given seed. Writes are issued as PUTX, like LLC
+ * writebacks. Requests are issued every gap cycles, except in dependent
+ * streams (pointer chasing), where each request waits for the previous one.
+ *
+ * Patterns, and the hybrid memory paths they stress:
+ *  - stream: sequential over the footprint. Bumblebee PRT misses (to free
+ *    HBM, then to DRAM once HBM fills), Hybrid2 XTA misses.
+ *  - stride: every stride lines, so few blocks per page are touched.
+ *    Bumblebee PRT misses with low spatial locality, Hybrid2 XTA misses
+ *    with cacheline misses.
+ *  - zipf: Zipfian page popularity, with the hot pages drifting over time.
+ *    Bumblebee swaps of pages that heat up in DRAM, Hybrid2 XTA hits and
+ *    remaps.
+ *  - phases: a hot set of pages that moves to a new region every phase.
+ *    Bumblebee evictions and swaps, Hybrid2 XTA misses and remaps.
+ *  - chase: dependent random accesses (a random cyclic permutation).
+ *    Latency-bound, with no reuse beyond the footprint.
+ */
+class SynthStream {
+    protected:
+        uint64_t cycle;
+        const uint64_t gap;
+        const double writeFraction;
+        std::mt19937_64 rng;
+
+    public:
+        SynthStream(uint64_t _gap, double _writeFraction, uint64_t seed)
+            : cycle(0), gap(_gap), writeFraction(_writeFraction), rng(seed) {}
+        virtual ~SynthStream() {}
+
+        void next(MemTraceRecord& rec) {
+            rec.cycle = cycle;
+            rec.lineAddr = nextLine();
+            rec.type = (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < writeFraction)? PUTX : GETS;
+            rec.srcId = 0;
+        }
+
+        // Call with the response cycle of every request
+        virtual void complete(uint64_t respCycle) {
+            cycle += gap;
+        }
+
+    protected:
+        virtual Address nextLine() = 0;
+
+        inline uint64_t random(uint64_t n) {
+            return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+        }
+};
+
+class StrideStream : public SynthStream {
+    private:
+        const uint64_t footprintLines;
+        const uint64_t stride;
+        uint64_t pos, base;
+
+    public:
+        StrideStream(uint64_t _footprintLines, uint64_t _stride, uint64_t _gap, double _writeFraction, uint64_t seed);
+
+    protected:
+        Address nextLine();
+};
+
+class ZipfStream : public SynthStream {
+    private:
+        const uint64_t numPages;
+        const uint64_t pageLines;
+        std::vector<double> cdf;  // by popularity rank
+        std::vector<uint64_t> pageOfRank;  // hot pages are scattered
+        const uint64_t driftPages;
+        const uint64_t driftRequests;
+        uint64_t drift;
+        uint64_t requests;
+
+    public:
+        ZipfStream(uint64_t _numPages, uint64_t _pageLines, double alpha, uint64_t _driftPages, uint64_t _driftRequests,
+                uint64_t _gap, double _writeFraction, uint64_t seed);
+
+    protected:
+        Address nextLine();
+};
+
+class PhaseStream : public SynthStream {
+    private:
+        const uint64_t numPages;
+        const uint64_t pageLines;
+        const uint64_t hotPages;
+        const double hotFraction;
+        const uint64_t phaseRequests;
+        uint64_t hotBase;
+        uint64_t requests;
+
+    public:
+        PhaseStream(uint64_t _numPages, uint64_t _pageLines, uint64_t _hotPages, double _hotFraction, uint64_t _phaseRequests,
+                uint64_t _gap, double _writeFraction, uint64_t seed);
+
+    protected:
+        Address nextLine();
+};
+
+class PointerChaseStream : public SynthStream {
+    private:
+        std::vector<uint32_t> succ;
+        uint64_t cur;
+
+    public:
+        PointerChaseStream(uint64_t footprintLines, uint64_t _gap, double _writeFraction, uint64_t seed);
+
+        void complete(uint64_t respCycle) {
+            cycle = respCycle + gap;
+        }
+
+    protected:
+        Address nextLine();
+};
+
+// Builds the given pattern (stream, stride, zipf, phases, chase), with parameters from the synth.* config keys
+SynthStream* BuildSynthStream(Config& config, const std::string& pattern, uint32_t lineSize);
+
+#endif  // SYNTH_STREAMS_H_
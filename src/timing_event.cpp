@@ -31,6 +31,8 @@
 
 /* TimingEvent */
 
+WeaveTrace* TimingEvent::trace = nullptr;
+
 void TimingEvent::parentDone(uint64_t startCycle) {
     cycle = MAX(cycle, startCycle);
     assert(numParents);
@@ -42,10 +44,10 @@ void TimingEvent::parentDone(uint64_t startCycle) {
     }
 }
 
-void TimingEvent::queue(uint64_t nextCycle) {
+void TimingEvent::queue(uint64_t nextCycle, uint32_t srcId) {
     assert(state == EV_NONE && numParents == 0);
     state = EV_QUEUED;
-    zinfo->contentionSim->enqueueSynced(this, nextCycle);
+    zinfo->contentionSim->enqueueSynced(this, nextCycle, srcId);
 }
 
 void TimingEvent::requeue(uint64_t nextCycle) {
@@ -170,6 +172,7 @@ void CrossingEvent::simulate(uint64_t simCycle) {
 
     uint64_t dCycle = MAX(simCycle, doneCycle);
     //info("Crossing %d->%d done %ld", srcDomain, domain, dCycle);
+    if (unlikely(trace != nullptr)) trace->record(WT_CROSSING, domain, dCycle, this, typeid(*this).name(), (((uint64_t)srcDomain) << 32) | (preSlack + postSlack));
     done(dCycle);
 }
 
@@ -32,6 +32,7 @@
 #include "bithacks.h"
 #include "event_recorder.h"
 #include "galloc.h"
+#include "weave_trace.h"
 
 #define TIMING_BLOCK_EVENTS 3
 struct TimingEventBlock {
@@ -87,6 +88,9 @@ class TimingEvent {
         uint32_t postDelay; //we could get by with one delay, but pre/post makes it easier to code
 
     public:
+        static WeaveTrace* trace; //non-null only during traced weave phases
+
+
         TimingEvent(uint32_t _preDelay, uint32_t _postDelay, int32_t _domain = -1) : next(nullptr), state(EV_NONE), cycle(0), minStartCycle(-1L), child(nullptr),
                     domain(_domain), numChildren(0), numParents(0), preDelay(_preDelay), postDelay(_postDelay) {}
         explicit TimingEvent(int32_t _domain = -1) : next(nullptr), state(EV_NONE), minStartCycle(-1L), child(nullptr),
@@ -145,7 +149,8 @@ class TimingEvent {
 
         //queue for the first time
         //always happens on PHASE 1 (bound), and is synchronized
-        void queue(uint64_t qCycle); //see cpp
+        //srcId is the enqueuing source, see ContentionSim::enqueueSynced
+        void queue(uint64_t qCycle, uint32_t srcId = (uint32_t)-1); //see cpp
 
         //mark an already-dequeued event for reexecution (simulate will be called again at the specified cycle)
         //always happens on PHASE 2 (weave), and is unsynchronized
@@ -157,6 +162,7 @@ class TimingEvent {
             assert(this);
             assert_msg(state == EV_NONE || state == EV_QUEUED, "state %d expected %d (%s)", state, EV_QUEUED, typeid(*this).name());
             state = EV_RUNNING;
+            if (unlikely(trace != nullptr)) trace->record(WT_RUN, domain, startCycle, this, typeid(*this).name(), 0);
 			// XXX HACK
             //assert_msg(startCycle >= minStartCycle, "startCycle %ld < minStartCycle %ld (%s), preDelay %d postDelay %d numChildren %d str %s",
             //        startCycle, minStartCycle, typeid(*this).name(), preDelay, postDelay, numChildren, str().c_str());
@@ -180,8 +186,10 @@ class TimingEvent {
         void done(uint64_t doneCycle) {
             assert(state == EV_RUNNING); //ContentionSim sets it when calling simulate()
             state = EV_DONE;
+            if (unlikely(trace != nullptr)) trace->record(WT_DONE, domain, doneCycle, this, typeid(*this).name(), numChildren);
             auto vLambda = [this, doneCycle](TimingEvent** childPtr) {
                 checkDomain(*childPtr);
+                if (unlikely(trace != nullptr)) trace->record(WT_EDGE, domain, doneCycle+postDelay, this, typeid(**childPtr).name(), (uint64_t)*childPtr);
                 (*childPtr)->parentDone(doneCycle+postDelay);
             };
             visitChildren< decltype(vLambda) >(vLambda);
@@ -304,6 +312,51 @@ class DelayEvent : public TimingEvent {
         }
 };
 
+/* Composite event for a sequential chain of operations, e.g., the several
+ * accesses a hybrid memory controller issues to the same channel per request.
+ * It behaves exactly like a chain of single-op events where each op starts
+ * postDelay + preDelay cycles after the previous op is done, but it is a
+ * single event: no per-op allocations, child links, or parentDone() calls.
+ *
+ * Subclasses store per-op state and implement loadOp(), which makes op i the
+ * current one (including its pre/postDelay). When the current op finishes,
+ * they call opDone() instead of done(). Ops can only be appended while the
+ * event is being recorded and has no children, since children depend on the
+ * last op.
+ */
+class MultiOpEvent : public TimingEvent {
+    private:
+        uint32_t numOps;
+        uint32_t curOp;
+
+    public:
+        MultiOpEvent(uint32_t preDelay, uint32_t postDelay, int32_t domain) : TimingEvent(preDelay, postDelay, domain), numOps(1), curOp(0) {}
+
+        inline uint32_t getNumOps() const {return numOps;}
+        inline uint32_t getCurOp() const {return curOp;}
+
+    protected:
+        // Returns the index of the new op
+        uint32_t appendOp() {
+            assert(getNumChildren() == 0 && curOp == 0);
+            return numOps++;
+        }
+
+        virtual void loadOp(uint32_t op) = 0;
+
+        // The current op is done at doneCycle. Finishes the event if this was the
+        // last op (freeing it, like done()), or requeues it for the next op.
+        void opDone(uint64_t doneCycle) {
+            if (curOp + 1 == numOps) {
+                done(doneCycle);
+            } else {
+                uint64_t nextCycle = doneCycle + getPostDelay();
+                loadOp(++curOp);
+                requeue(nextCycle + getPreDelay());
+            }
+        }
+};
+
 class CrossingEvent : public TimingEvent {
     private:
         uint32_t srcDomain;
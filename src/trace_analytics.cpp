@@ -0,0 +1,168 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace_analytics.h"
+#include <algorithm>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+
+static const uint32_t HOTNESS_BINS = 24;  // [2^i, 2^(i+1)) accesses per epoch, last bin is open-ended
+
+TraceAnalytics::TraceAnalytics(double rate, uint32_t _maxLines, double pageRate, uint32_t pageLines, uint64_t _epochCycles)
+    : maxLines(_maxLines), curTime(0), sampledRefs(0), pageBits(ilog2(pageLines)),
+      pageThreshold(MAX(1.0, MIN(1.0, pageRate)*(1ul << HASH_BITS))), epochCycles(_epochCycles), epochs(0)
+{
+    if (maxLines == 0) panic("TraceAnalytics: need to track at least one line");
+    if (!isPow2(pageLines) || pageLines > 64) panic("TraceAnalytics: lines per page (%d) must be a power of 2 <= 64", pageLines);
+    if (epochCycles == 0) panic("TraceAnalytics: epoch must be > 0 cycles");
+    threshold = MAX(1.0, MIN(1.0, rate)*(1ul << HASH_BITS));
+    timeTree.resize(4*maxLines + 1, 0);  // compacted when full
+    reuseHist.resize(REUSE_BINS, 0.0);
+    epochEnd = epochCycles;
+    hotnessHist.resize(HOTNESS_BINS, 0.0);
+    blocksHist.resize(pageLines, 0.0);
+    pendingHotness.resize(HOTNESS_BINS, 0.0);
+    pendingBlocks.resize(pageLines, 0.0);
+    pendingValid = true;
+}
+
+void TraceAnalytics::initStats(AggregateStat* parentStat) {
+    AggregateStat* anStat = new AggregateStat();
+    anStat->init("analytics", "Online access stream analytics");
+
+    auto reuseStat = makeLambdaVectorStat([this](uint32_t i) { return (uint64_t)(reuseHist[i] + 0.5); }, REUSE_BINS);
+    reuseStat->init("reuseDist", "Reuse distance histogram (estimated refs): 0, [2^(i-1), 2^i) distinct lines, cold (last bin)");
+    anStat->append(reuseStat);
+    auto refsStat = makeLambdaStat([this]() { return sampledRefs; });
+    refsStat->init("sampledRefs", "References sampled for reuse distances");
+    anStat->append(refsStat);
+    auto rateStat = makeLambdaStat([this]() { return ((uint64_t)threshold*1000000) >> HASH_BITS; });
+    rateStat->init("sampleRate", "Current line sampling rate (ppm)");
+    anStat->append(rateStat);
+
+    // Page stats include the current epoch, which otherwise would only be counted once a later access ends it
+    auto hotStat = makeLambdaVectorStat([this](uint32_t i) {
+        updatePending();
+        return (uint64_t)(hotnessHist[i] + pendingHotness[i] + 0.5);
+    }, HOTNESS_BINS);
+    hotStat->init("pageHotness", "Pages per epoch with [2^i, 2^(i+1)) accesses (estimated, summed over epochs)");
+    anStat->append(hotStat);
+    auto blocksStat = makeLambdaVectorStat([this](uint32_t i) {
+        updatePending();
+        return (uint64_t)(blocksHist[i] + pendingBlocks[i] + 0.5);
+    }, blocksHist.size());
+    blocksStat->init("pageBlocks", "Pages per epoch with i+1 blocks touched (estimated, summed over epochs)");
+    anStat->append(blocksStat);
+    auto epochsStat = makeLambdaStat([this]() { return epochs + (pages.empty()? 0 : 1); });
+    epochsStat->init("epochs", "Page stats epochs, including the current one if it has accesses");
+    anStat->append(epochsStat);
+
+    parentStat->append(anStat);
+}
+
+void TraceAnalytics::sampleLine(Address lineAddr, uint32_t lineHash) {
+    double weight = (double)(1ul << HASH_BITS)/threshold;  // refs represented by this one
+    sampledRefs++;
+    g_unordered_map<Address, LineInfo>::iterator it = lines.find(lineAddr);
+    if (it != lines.end()) {
+        // Distance = tracked lines accessed since our last access, scaled by the sampling rate
+        uint64_t last = it->second.time;
+        uint64_t dist = treeCount(curTime - 1) - treeCount(last);
+        uint32_t bin = dist? MIN(1 + ilog2((uint64_t)(dist*weight)), REUSE_BINS - 2) : 0;
+        reuseHist[bin] += weight;
+        treeAdd(last, -1);
+        it->second.time = curTime;
+    } else {
+        reuseHist[REUSE_BINS - 1] += weight;
+        lines[lineAddr] = {curTime, lineHash};
+        lineHeap.push_back(std::make_pair(lineHash, lineAddr));
+        std::push_heap(lineHeap.begin(), lineHeap.end());
+    }
+    treeAdd(curTime, 1);
+    curTime++;
+
+    // Over budget: lower the threshold to the highest tracked hash, and drop the lines at it
+    while (lines.size() > maxLines) {
+        threshold = lineHeap.front().first;
+        while (!lineHeap.empty() && lineHeap.front().first == threshold) {
+            std::pop_heap(lineHeap.begin(), lineHeap.end());
+            Address victim = lineHeap.back().second;
+            lineHeap.pop_back();
+            treeAdd(lines[victim].time, -1);
+            lines.erase(victim);
+        }
+    }
+
+    if (curTime == timeTree.size() - 1) compactTimes();
+}
+
+void TraceAnalytics::foldPages(g_vector<double>& hot, g_vector<double>& blocks) const {
+    double weight = (double)(1ul << HASH_BITS)/pageThreshold;
+    for (auto& p : pages) {
+        hot[MIN(ilog2(p.second.accesses), HOTNESS_BINS - 1)] += weight;
+        blocks[__builtin_popcountl(p.second.blocks) - 1] += weight;
+    }
+}
+
+void TraceAnalytics::updatePending() {
+    if (pendingValid) return;
+    std::fill(pendingHotness.begin(), pendingHotness.end(), 0.0);
+    std::fill(pendingBlocks.begin(), pendingBlocks.end(), 0.0);
+    foldPages(pendingHotness, pendingBlocks);
+    pendingValid = true;
+}
+
+void TraceAnalytics::endEpoch(uint64_t cycle) {
+    foldPages(hotnessHist, blocksHist);
+    pages.clear();
+    pendingValid = false;
+    epochs += (cycle - epochEnd)/epochCycles + 1;
+    epochEnd = (cycle/epochCycles + 1)*epochCycles;
+}
+
+void TraceAnalytics::treeAdd(uint64_t time, int32_t delta) {
+    for (uint64_t i = time + 1; i < timeTree.size(); i += i & -i) timeTree[i] += delta;
+}
+
+uint64_t TraceAnalytics::treeCount(uint64_t time) const {
+    uint64_t res = 0;
+    for (uint64_t i = time + 1; i > 0; i -= i & -i) res += timeTree[i];
+    return res;
+}
+
+// Renumbers access times densely, preserving their order
+void TraceAnalytics::compactTimes() {
+    std::vector<std::pair<uint64_t, Address>> order;
+    order.reserve(lines.size());
+    for (auto& l : lines) order.push_back(std::make_pair(l.second.time, l.first));
+    std::sort(order.begin(), order.end());
+    std::fill(timeTree.begin(), timeTree.end(), 0);
+    for (uint64_t t = 0; t < order.size(); t++) {
+        lines[order[t].second].time = t;
+        treeAdd(t, 1);
+    }
+    curTime = order.size();
+}
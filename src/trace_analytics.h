@@ -0,0 +1,122 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_ANALYTICS_H_
+#define TRACE_ANALYTICS_H_
+
+#include <stdint.h>
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Online analytics over an access stream, computed at a trace tap point
+ * instead of offline over the written trace:
+ *  - Reuse distances (in distinct lines), approximated with fixed-size
+ *    SHARDS: only lines whose hash falls below a threshold are tracked,
+ *    and the threshold drops to evict the highest-hash line whenever more
+ *    than maxLines are tracked. Each sampled reference counts as 1/rate.
+ *  - Page hotness: per epoch, how many pages got [2^i, 2^(i+1)) accesses
+ *    (the last bin is open-ended).
+ *  - Spatial locality: per epoch, how many pages had i+1 blocks touched.
+ * Pages can be hash-sampled too. Histograms are cumulative over epochs,
+ * so periodic stats dumps give their evolution over time; they include the
+ * current, partial epoch, so short runs still report page stats.
+ */
+class TraceAnalytics : public GlobAlloc {
+    private:
+        static const uint32_t HASH_BITS = 24;  // sampling thresholds are in [0, 2^HASH_BITS]
+        static const uint32_t REUSE_BINS = 42;  // 0, [2^(i-1), 2^i) for i in 1..40, and cold
+
+        // Reuse distance sampling
+        struct LineInfo {
+            uint64_t time;  // of the last access, in sampled references
+            uint32_t hash;
+        };
+        g_unordered_map<Address, LineInfo> lines;
+        g_vector<std::pair<uint32_t, Address>> lineHeap;  // max-heap on hash, for evictions
+        const uint32_t maxLines;
+        uint32_t threshold;
+        g_vector<uint32_t> timeTree;  // Fenwick tree over access times, marks each tracked line's last access
+        uint64_t curTime;
+        g_vector<double> reuseHist;
+        uint64_t sampledRefs;
+
+        // Page stats, reset every epoch
+        struct PageInfo {
+            uint64_t blocks;  // bitmap
+            uint64_t accesses;
+        };
+        g_unordered_map<Address, PageInfo> pages;
+        const uint32_t pageBits;  // lines per page, log2
+        const uint32_t pageThreshold;
+        const uint64_t epochCycles;
+        uint64_t epochEnd;
+        uint64_t epochs;
+        g_vector<double> hotnessHist;
+        g_vector<double> blocksHist;
+        g_vector<double> pendingHotness;  // the current epoch's pages, folded in lazily for stats
+        g_vector<double> pendingBlocks;
+        bool pendingValid;
+
+    public:
+        // rate: initial line sampling rate; pageRate: fixed page sampling rate; pageLines <= 64
+        TraceAnalytics(double rate, uint32_t _maxLines, double pageRate, uint32_t pageLines, uint64_t _epochCycles);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Not thread-safe, callers must serialize
+        inline void record(Address lineAddr, uint64_t cycle) {
+            if (cycle >= epochEnd) endEpoch(cycle);
+            uint32_t lineHash = hash(lineAddr);
+            if (lineHash < threshold) sampleLine(lineAddr, lineHash);
+            Address page = lineAddr >> pageBits;
+            if (hash(page) < pageThreshold) {
+                PageInfo& pi = pages[page];
+                pi.blocks |= 1ul << (lineAddr & ((1ul << pageBits) - 1));
+                pi.accesses++;
+                pendingValid = false;
+            }
+        }
+
+    private:
+        static inline uint32_t hash(uint64_t x) {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ul;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebul;
+            return (x ^ (x >> 31)) & ((1ul << HASH_BITS) - 1);
+        }
+
+        void sampleLine(Address lineAddr, uint32_t lineHash);
+        void endEpoch(uint64_t cycle);
+        void foldPages(g_vector<double>& hot, g_vector<double>& blocks) const;
+        void updatePending();
+
+        void treeAdd(uint64_t time, int32_t delta);
+        uint64_t treeCount(uint64_t time) const;  // marks at times <= time
+        void compactTimes();
+};
+
+#endif  // TRACE_ANALYTICS_H_
@@ -24,18 +24,42 @@
  */
 
 #include <sstream>
+#include "bithacks.h"
 #include "trace_driver.h"
+#include "trace_sampler.h"
 #include "zsim.h"
 
-TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
-    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
+TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads)
+    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets), sampler(nullptr)
 {
     assert(numChildren > 0);
-    assert(!useSkews || numChildren == 1);
     if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
     children = new ChildInfo[numChildren];
     futex_init(&lock);
     lastAcc.childId = -1;
+
+    //Skews shift each child's stream differently, so they need per-child streams
+    numThreads = MAX(1u, MIN(_numThreads, numChildren));
+    parallel = numThreads > 1 || (useSkews && numChildren > 1);
+    for (uint32_t c = 0; c < numChildren; c++) {
+        children[c].skew = 0;
+        children[c].lastReqCycle = 0;
+        futex_init(&children[c].lock);
+        children[c].localPos = 0;
+        children[c].done = false;
+    }
+    futex_init(&demuxLock);
+    wakeLocks = new lock_t[numThreads];
+    for (uint32_t t = 0; t < numThreads; t++) {
+        futex_init(&wakeLocks[t]);
+        futex_lock(&wakeLocks[t]); //starts locked, so helpers block until the first phase
+    }
+    futex_init(&waitLock);
+    futex_lock(&waitLock);
+    threadTicket = 1;
+    threadsPending = 0;
+    phaseLimit = 0;
+    if (parallel) info("TraceDriver: parallel replay of %d children on %d threads", numChildren, numThreads);
     parent = proxies[0]->getParent();
     for (uint32_t i = 0; i < numChildren; i++) proxies[i]->setDriver(this);
 
@@ -76,34 +100,64 @@ void TraceDriver::setParent(MemObject* _parent) {
 
 uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
     assert(childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
-    std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
-    assert((it != cStore.end()));
-    *reqWriteback = (it->second == M);
+    if (parallel) futex_lock(&children[childId].lock);
+    MESIState* state = children[childId].cStore.find(lineAddr);
+    assert(state);
+    *reqWriteback = (*state == M);
     if (type == INVX) {
-        it->second = S;
+        *state = S;
         children[childId].profInvx.inc();
     } else {
-        cStore.erase(it);
+        *state = I; //removes it
         if (srcId == childId) {
             children[childId].profSelfInv.inc();
         } else {
             children[childId].profCrossInv.inc();
         }
     }
+    if (parallel) futex_unlock(&children[childId].lock);
     return 0;
 }
 
+void TraceDriver::initSampling(TraceSampler* _sampler) {
+    if (parallel) panic("Sampled trace replay requires serial replay (sim.traceThreads = 1, and no skews with multiple children)");
+    sampler = _sampler;
+}
+
+//Serial mode: reads the next record to replay, dropping the ones outside sampled regions. Returns false at the end of the trace.
+bool TraceDriver::nextRecord(AccessRecord& acc) {
+    while (!tr.empty()) {
+        acc = tr.read();
+        if (sampler && !sampler->filter(acc.reqCycle, &acc.reqCycle)) continue;
+        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        return true;
+    }
+    if (sampler) sampler->finish();
+    return false;
+}
+
 //Returns false if done, true otherwise
 bool TraceDriver::executePhase() {
     uint64_t limit = zinfo->globPhaseCycles + zinfo->phaseLength;
 
+    if (parallel) {
+        phaseLimit = limit;
+        threadsPending = numThreads - 1;
+        __sync_synchronize();
+        for (uint32_t t = 1; t < numThreads; t++) futex_unlock(&wakeLocks[t]);
+        replayChildren(0, limit);
+        if (numThreads > 1) futex_lock_nospin(&waitLock); //wait for helpers
+
+        for (uint32_t c = 0; c < numChildren; c++) {
+            if (!children[c].done) return true;
+        }
+        return false;
+    }
+
     //Load valid access
     AccessRecord acc;
     if (lastAcc.childId == (uint32_t)-1) {
-        if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        if (!nextRecord(acc)) return false;
     } else {
         acc = lastAcc;
         lastAcc.childId = (uint32_t)-1;
@@ -111,19 +165,74 @@ bool TraceDriver::executePhase() {
 
     //Run until we reach the cycle limit or run out of phases
     while (acc.reqCycle < limit) {
-        executeAccess(acc);
-        if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        executeAccess(acc, nullptr);
+        if (!nextRecord(acc)) return false;
     }
 
     lastAcc = acc; //save this access for the next phase
     return true;
 }
 
-void TraceDriver::executeAccess(AccessRecord acc) {
+//Parallel mode: replays this thread's children up to the limit
+void TraceDriver::replayChildren(uint32_t thread, uint64_t limit) {
+    for (uint32_t c = thread; c < numChildren; c += numThreads) {
+        ChildInfo& child = children[c];
+        while (!child.done) {
+            if (child.localPos == child.local.size() && !refill(c, limit)) break;
+            AccessRecord acc = child.local[child.localPos];
+            if (useSkews) acc.reqCycle += child.skew;
+            if (acc.reqCycle >= limit) break;
+            child.localPos++;
+            futex_lock(&child.lock);
+            executeAccess(acc, &child.lock);
+            futex_unlock(&child.lock);
+        }
+    }
+}
+
+//Parallel mode: moves the child's demultiplexed records to its local buffer, reading the trace if there are none.
+//Returns false if the child has no records left this phase; stops reading at records past the child's limit, as traces are sorted,
+//and once another child's backlog reaches MAX_PENDING.
+bool TraceDriver::refill(uint32_t childId, uint64_t limit) {
+    const uint32_t BATCH = 1024; //records read ahead per child, to amortize locking
+    const uint32_t MAX_PENDING = 64*BATCH; //per-child backlog past which other children stop reading ahead
+    ChildInfo& child = children[childId];
+    child.local.clear();
+    child.localPos = 0;
+    int64_t childLimit = (int64_t)limit - (useSkews? child.skew : 0); //in unskewed trace cycles
+
+    futex_lock(&demuxLock);
+    while (child.pending.size() < BATCH && !tr.empty()) {
+        AccessRecord acc = tr.read();
+        assert(acc.childId < numChildren);
+        std::vector<AccessRecord>& dst = children[acc.childId].pending;
+        dst.push_back(acc);
+        if (child.pending.empty() && (int64_t)acc.reqCycle >= childLimit) break;
+        //A child that is not draining its records (replayed later by its thread, or past its limit) pauses the
+        //read-ahead: its backlog only grows further while this child has nothing to replay
+        if (dst.size() >= MAX_PENDING && !child.pending.empty()) break;
+    }
+    bool exhausted = tr.empty();
+    std::swap(child.local, child.pending);
+    futex_unlock(&demuxLock);
+
+    if (child.local.empty() && exhausted) child.done = true;
+    return !child.local.empty();
+}
+
+void TraceDriver::helperLoop() {
+    uint32_t thread = __sync_fetch_and_add(&threadTicket, 1);
+    assert(thread > 0 && thread < numThreads);
+    while (true) {
+        futex_lock_nospin(&wakeLocks[thread]);
+        replayChildren(thread, phaseLimit);
+        if (__sync_sub_and_fetch(&threadsPending, 1) == 0) futex_unlock(&waitLock);
+    }
+}
+
+void TraceDriver::executeAccess(AccessRecord acc, lock_t* childLock) {
     assert(acc.childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
+    LineStateMap& cStore = children[acc.childId].cStore;
 
     int64_t lat = 0;
     switch (acc.type) {
@@ -131,39 +240,39 @@ void TraceDriver::executeAccess(AccessRecord acc) {
         case PUTX:
             {
                 if (!playPuts) return;
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                MESIState* state = cStore.find(acc.lineAddr);
+                if (!state) return; //we don't currently have this line, skip
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, state, acc.reqCycle, childLock, *state, acc.childId};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
-                assert(it->second == I);
-                cStore.erase(it);
+                assert(*state == I); //removes it
             }
             break;
         case GETS:
         case GETX:
             {
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
+                MESIState* cState = cStore.find(acc.lineAddr);
                 MESIState state = I;
-                if (it != cStore.end()) {
-                    if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
+                MESIState* reqState = &state;
+                if (cState) {
+                    if (!((*cState == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            MemReq req = {acc.lineAddr, (*cState == M)? PUTX : PUTS, acc.childId, cState, acc.reqCycle, childLock, *cState, acc.childId};
                             parent->access(req);
-                            assert(it->second == I);
+                            assert(*cState == I);
                         } else {
                             return; //skip
                         }
                     } else {
-                        state = it->second;
+                        reqState = cState; //upgrade; the parent sees invalidations that race with it
                     }
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, reqState, acc.reqCycle, childLock, *reqState, acc.childId};
                 uint64_t respCycle = parent->access(req);
                 lat = respCycle - acc.reqCycle;
                 children[acc.childId].profLat.inc(lat);
                 children[acc.childId].skew += ((int64_t)lat - acc.latency);
-                assert(state != I);
-                cStore[acc.lineAddr] = state;
+                assert(*reqState != I);
+                cStore.insert(acc.lineAddr, *reqState);
             }
             break;
         default:
@@ -176,7 +285,9 @@ void TraceDriver::executeAccess(AccessRecord acc) {
         // We always want the outout trace to be skewed regardless... otherwise it does not make sense to produce an output trace
         if (!useSkews) wAcc.reqCycle += children[acc.childId].skew;
         wAcc.latency = lat;
+        if (parallel) futex_lock(&lock);
         atw->write(wAcc);
+        if (parallel) futex_unlock(&lock);
     }
 }
 
@@ -26,20 +26,116 @@
 #ifndef __TRACE_DRIVER_H__
 #define __TRACE_DRIVER_H__
 
-#include <unordered_map>
 #include <vector>
 #include "access_tracing.h"
 #include "g_std/g_string.h"
+#include "locks.h"
 #include "stats.h"
 
-/* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it */
+class TraceSampler;
+
+/* Set of the lines a child holds, with their states. Open addressing with
+ * linear probing. Removing a line just sets its state to I, so state pointers
+ * stay valid while an access that may invalidate the line is in flight; I
+ * entries are reused by inserts and dropped when the table is rebuilt.
+ * Only insert() changes the layout; callers must serialize it with lookups.
+ */
+class LineStateMap {
+    private:
+        struct Entry {
+            Address lineAddr;
+            MESIState state;
+        };
+
+        static const Address EMPTY = ~((Address)0);
+
+        Entry* table;
+        uint32_t bits;
+        uint64_t used;  // non-empty entries, including I ones
+
+    public:
+        LineStateMap() : table(nullptr), bits(0), used(0) {
+            rebuild(10);
+        }
+
+        ~LineStateMap() {
+            delete[] table;
+        }
+
+        // Returns the state of a line the child holds, or nullptr
+        inline MESIState* find(Address lineAddr) {
+            uint64_t mask = (1ul << bits) - 1;
+            for (uint64_t i = hash(lineAddr);; i = (i + 1) & mask) {
+                Entry& e = table[i];
+                if (e.lineAddr == lineAddr) return (e.state == I)? nullptr : &e.state;
+                if (e.lineAddr == EMPTY) return nullptr;
+            }
+        }
+
+        void insert(Address lineAddr, MESIState state) {
+            assert(lineAddr != EMPTY && state != I);
+            uint64_t mask = (1ul << bits) - 1;
+            Entry* free = nullptr;
+            for (uint64_t i = hash(lineAddr);; i = (i + 1) & mask) {
+                Entry& e = table[i];
+                if (e.lineAddr == lineAddr) {
+                    e.state = state;
+                    return;
+                }
+                if (!free && e.state == I) free = &e;  // reusable (empty or removed)
+                if (e.lineAddr == EMPTY) break;
+            }
+            if (free->lineAddr == EMPTY) {
+                if ((used + 1)*4 > (3ul << bits)) {  // keep load <= 75%
+                    rebuild(bits);
+                    insert(lineAddr, state);
+                    return;
+                }
+                used++;
+            }
+            free->lineAddr = lineAddr;
+            free->state = state;
+        }
+
+    private:
+        inline uint64_t hash(Address lineAddr) const {
+            return (lineAddr * 0x9E3779B97F4A7C15ul) >> (64 - bits);
+        }
+
+        // Drops removed lines, and grows the table if still over half full
+        void rebuild(uint32_t minBits) {
+            Entry* old = table;
+            uint64_t oldSize = old? (1ul << bits) : 0;
+            uint64_t valid = 0;
+            for (uint64_t i = 0; i < oldSize; i++) valid += (old[i].state != I);
+            bits = minBits;
+            while (valid*2 > (1ul << bits)) bits++;
+            table = new Entry[1ul << bits];
+            for (uint64_t i = 0; i < (1ul << bits); i++) table[i] = {EMPTY, I};
+            used = 0;
+            for (uint64_t i = 0; i < oldSize; i++) {
+                if (old[i].state != I) insert(old[i].lineAddr, old[i].state);
+            }
+            delete[] old;
+        }
+};
+
+/* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it.
+ *
+ * By default, the trace is replayed in order on the simulation thread. In
+ * parallel mode (sim.traceThreads > 1, or skews with multiple children), the
+ * trace is demultiplexed into per-child streams, and children are replayed
+ * on separate threads, each up to the phase limit, like cores in the bound
+ * phase. Children then use the same hand-over-hand locking as caches, so
+ * invalidations from other children's accesses are handled as races.
+ */
 
 class TraceDriverProxyCache;
 
 class TraceDriver {
     private:
         struct ChildInfo {
-            std::unordered_map<Address, MESIState> cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
+            LineStateMap cStore; //holds current sets of lines for each child
             int64_t skew;
             uint64_t lastReqCycle;
             //Counter bypassedGETS;
@@ -48,34 +144,64 @@ class TraceDriver {
             Counter profSelfInv; //invalidations in response to our own access
             Counter profCrossInv; //invalidations in response to another access
             Counter profInvx;
+
+            // Parallel mode
+            lock_t lock; //held by the replaying thread, released by the parent during accesses
+            std::vector<AccessRecord> pending; //demultiplexed records, protected by demuxLock
+            std::vector<AccessRecord> local; //records being replayed, owned by the replaying thread
+            size_t localPos;
+            bool done; //no records left
         };
 
         ChildInfo* children;
-        lock_t lock; //NOTE: not needed for now
+        lock_t lock; //serializes retrace writes in parallel mode
         AccessTraceReader tr;
         uint32_t numChildren;
-        bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child.
+        bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child, unless in parallel mode.
         bool playPuts; //If true, issues PUTS/PUTX requests as they appear in the trace. If false, it just issues the GETS/X requests, leaving it up to the parent to decide when to evict something (NOTE: if the parent is running OPT, it knows better!)
         bool playAllGets; //If true, if we have a get to an address that we already have, issue a put immediately before.
         MemObject* parent;
 
         AccessTraceWriter* atw;
+        TraceSampler* sampler; //if non-null, only replays sampled regions of the trace
 
         //Last access, childId == -1 if invalid, acts as 1-elem buffer
         AccessRecord lastAcc;
 
+        //Parallel mode; thread 0 is the simulation thread, the others are helpers that wake up every phase
+        bool parallel;
+        uint32_t numThreads;
+        lock_t demuxLock;
+        lock_t* wakeLocks; //per helper thread, unlocked to start a phase
+        lock_t waitLock; //unlocked when all helpers finish the phase
+        volatile uint32_t threadTicket;
+        volatile uint32_t threadsPending;
+        uint64_t phaseLimit;
+
     public:
-        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets);
+        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads);
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
+        AccessTraceReader* getTraceReader() {return &tr;}
+        void initSampling(TraceSampler* _sampler);
 
         uint64_t invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId);
 
         //Returns false if done, true otherwise
         bool executePhase();
 
+        //Parallel mode: spawn getNumHelperThreads() threads that run helperLoop()
+        uint32_t getNumHelperThreads() const {return parallel? numThreads - 1 : 0;}
+        void helperLoop();
+        static void HelperThreadTrampoline(void* arg) {
+            static_cast<TraceDriver*>(arg)->helperLoop();
+        }
+
     private:
-        inline void executeAccess(AccessRecord acc);
+        inline bool nextRecord(AccessRecord& acc);
+        inline void executeAccess(AccessRecord acc, lock_t* childLock);
+        void replayChildren(uint32_t thread, uint64_t limit);
+        bool refill(uint32_t childId, uint64_t limit);
 };
 
 
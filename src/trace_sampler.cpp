@@ -0,0 +1,327 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace_sampler.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <regex>
+#include <stdio.h>
+#include "access_tracing.h"
+#include "bithacks.h"
+#include "zsim.h"
+
+static inline uint64_t mix64(uint64_t x) {  // splitmix64 finalizer
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ul;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebul;
+    return x ^ (x >> 31);
+}
+
+TraceSampler::TraceSampler(Mode _mode, uint64_t _intervalCycles, uint64_t _period, uint64_t _warmupCycles, uint32_t numClusters,
+        uint64_t _seed, const char* _statsRegex, const std::string& traceFile, const g_string& _reportFile)
+    : mode(_mode), intervalCycles(_intervalCycles), period(_period), warmupCycles(_warmupCycles), seed(_seed),
+      statsRegex(_statsRegex), reportFile(_reportFile), numIntervals(0),
+      region(SKIP), regionStart(0), regionEnd(0), replayEnd(0), skippedCycles(0), curInterval(-1), flatStats(nullptr), numSamples(0)
+{
+    if (intervalCycles == 0) panic("Sampling interval must be > 0 cycles");
+    if (mode != CLUSTERED && period == 0) panic("Sampling period must be > 0 intervals");
+    if (mode == CLUSTERED) {
+        if (numClusters == 0) panic("Clustered sampling needs at least one cluster");
+        cluster(traceFile, numClusters);
+    }
+}
+
+uint64_t TraceSampler::nextMeasured(uint64_t interval) const {
+    switch (mode) {
+        case SYSTEMATIC:
+            return interval + (period - 1 - interval % period);
+        case RANDOM:
+            {
+                uint64_t group = interval / period;
+                uint64_t m = group*period + mix64(seed ^ mix64(group)) % period;
+                if (m < interval) m = (group + 1)*period + mix64(seed ^ mix64(group + 1)) % period;
+                return m;
+            }
+        case CLUSTERED:
+            {
+                std::vector<uint64_t>::const_iterator it = std::lower_bound(selected.begin(), selected.end(), interval);
+                return (it == selected.end())? -1 : *it;
+            }
+        default:
+            panic("Invalid sampling mode %d", mode);
+    }
+}
+
+void TraceSampler::advance(uint64_t traceCycle) {
+    if (region == MEASURE) endSample();
+
+    uint64_t interval = traceCycle / intervalCycles;
+    if (mode != CLUSTERED) numIntervals = MAX(numIntervals, interval + 1);
+
+    // Measured intervals with no records in them (e.g., idle periods) are samples too, with no change in stats
+    for (uint64_t m = nextMeasured(curInterval + 1); m < interval; m = nextMeasured(m + 1)) numSamples++;
+    curInterval = interval;
+
+    uint64_t m = nextMeasured(interval);
+    if (m == interval) {
+        region = MEASURE;
+        regionStart = interval*intervalCycles;
+        regionEnd = regionStart + intervalCycles;
+    } else if (m == (uint64_t)-1) {
+        region = SKIP;
+        regionStart = traceCycle;
+        regionEnd = -1;
+    } else {
+        uint64_t measureStart = m*intervalCycles;
+        uint64_t warmupStart = (measureStart > warmupCycles)? measureStart - warmupCycles : 0;
+        if (traceCycle >= warmupStart) {
+            region = WARMUP;
+            regionStart = warmupStart;
+            regionEnd = measureStart;
+        } else {
+            region = SKIP;
+            regionStart = traceCycle;
+            regionEnd = warmupStart;
+        }
+    }
+
+    if (region != SKIP) {
+        // Close the gap between replayed regions, so skipped cycles take no simulated time
+        regionStart = MAX(regionStart, replayEnd);
+        if (regionStart > replayEnd) skippedCycles += regionStart - replayEnd;
+        replayEnd = regionEnd;
+        if (region == MEASURE) beginSample();
+    }
+}
+
+void TraceSampler::cluster(const std::string& traceFile, uint32_t numClusters) {
+    const uint32_t DIMS = 64;
+
+    // Profiling pass: accesses per hashed page, per interval
+    std::vector<float> vecs;
+    std::vector<uint64_t> accs;
+    AccessTraceReader tr(traceFile);
+    while (!tr.empty()) {
+        AccessRecord acc = tr.read();
+        uint64_t interval = acc.reqCycle / intervalCycles;
+        if (interval >= numIntervals) {
+            numIntervals = interval + 1;
+            vecs.resize(numIntervals*DIMS, 0.0);
+            accs.resize(numIntervals, 0);
+        }
+        vecs[interval*DIMS + mix64(acc.lineAddr >> 6) % DIMS] += 1.0;
+        accs[interval]++;
+    }
+    if (numIntervals == 0) panic("Clustered sampling: trace %s is empty", traceFile.c_str());
+    for (uint64_t i = 0; i < numIntervals; i++) {
+        if (accs[i]) for (uint32_t d = 0; d < DIMS; d++) vecs[i*DIMS + d] /= accs[i];
+    }
+
+    auto dist = [&](const float* a, const float* b) {
+        double res = 0.0;
+        for (uint32_t d = 0; d < DIMS; d++) res += (a[d] - b[d])*(a[d] - b[d]);
+        return res;
+    };
+
+    // k-means++ seeding
+    std::mt19937_64 rng(seed);
+    uint64_t k = MIN((uint64_t)numClusters, numIntervals);
+    uint64_t first = rng() % numIntervals;
+    std::vector<float> centroids(vecs.begin() + first*DIMS, vecs.begin() + (first + 1)*DIMS);
+    std::vector<double> minDist(numIntervals);
+    for (uint64_t i = 0; i < numIntervals; i++) minDist[i] = dist(&vecs[i*DIMS], &centroids[0]);
+    uint64_t numCentroids = 1;
+    while (numCentroids < k) {
+        double total = 0.0;
+        for (double d : minDist) total += d;
+        if (total == 0.0) break;  // all intervals match some centroid already
+        double r = std::uniform_real_distribution<double>(0.0, total)(rng);
+        uint64_t pick = 0;
+        while (pick < numIntervals - 1 && r >= minDist[pick]) r -= minDist[pick++];
+        centroids.insert(centroids.end(), vecs.begin() + pick*DIMS, vecs.begin() + (pick + 1)*DIMS);
+        const float* c = &centroids[numCentroids*DIMS];
+        for (uint64_t i = 0; i < numIntervals; i++) minDist[i] = MIN(minDist[i], dist(&vecs[i*DIMS], c));
+        numCentroids++;
+    }
+
+    // Lloyd iterations
+    std::vector<uint32_t> assign(numIntervals, -1);
+    std::vector<uint64_t> sizes(numCentroids);
+    for (uint32_t iter = 0; iter < 100; iter++) {
+        bool changed = false;
+        for (uint64_t i = 0; i < numIntervals; i++) {
+            uint32_t best = 0;
+            double bestDist = dist(&vecs[i*DIMS], &centroids[0]);
+            for (uint32_t c = 1; c < numCentroids; c++) {
+                double d = dist(&vecs[i*DIMS], &centroids[c*DIMS]);
+                if (d < bestDist) {
+                    best = c;
+                    bestDist = d;
+                }
+            }
+            if (assign[i] != best) changed = true;
+            assign[i] = best;
+        }
+        if (!changed) break;
+
+        std::vector<double> acc(numCentroids*DIMS, 0.0);
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (uint64_t i = 0; i < numIntervals; i++) {
+            sizes[assign[i]]++;
+            for (uint32_t d = 0; d < DIMS; d++) acc[assign[i]*DIMS + d] += vecs[i*DIMS + d];
+        }
+        for (uint32_t c = 0; c < numCentroids; c++) {
+            if (!sizes[c]) continue;  // empty cluster, keep its centroid
+            for (uint32_t d = 0; d < DIMS; d++) centroids[c*DIMS + d] = acc[c*DIMS + d]/sizes[c];
+        }
+    }
+
+    // Pick the interval closest to each centroid, weighted by its cluster size
+    std::vector<uint64_t> reps(numCentroids, -1);
+    std::vector<double> repDist(numCentroids);
+    std::fill(sizes.begin(), sizes.end(), 0);
+    for (uint64_t i = 0; i < numIntervals; i++) {
+        uint32_t c = assign[i];
+        double d = dist(&vecs[i*DIMS], &centroids[c*DIMS]);
+        if (reps[c] == (uint64_t)-1 || d < repDist[c]) {
+            reps[c] = i;
+            repDist[c] = d;
+        }
+        sizes[c]++;
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> sel;
+    for (uint32_t c = 0; c < numCentroids; c++) {
+        if (sizes[c]) sel.push_back(std::make_pair(reps[c], sizes[c]));
+    }
+    std::sort(sel.begin(), sel.end());
+    for (auto& s : sel) {
+        selected.push_back(s.first);
+        weights.push_back(s.second);
+    }
+    info("TraceSampler: %ld intervals of %ld cycles in %ld clusters", numIntervals, intervalCycles, selected.size());
+}
+
+// Names the leaf values that match filter, and finds their positions in a FlatStats snapshot (inorder walk)
+static void FlattenStats(const AggregateStat* src, const std::regex& filter, const std::string& prefix,
+        std::vector<std::string>& names, std::vector<uint32_t>& positions, uint32_t& pos) {
+    for (uint32_t i = 0; i < src->size(); i++) {
+        Stat* child = src->get(i);
+        std::string name = prefix + child->name();
+        if (AggregateStat* as = dynamic_cast<AggregateStat*>(child)) {
+            FlattenStats(as, filter, name + ".", names, positions, pos);
+        } else if (VectorStat* vs = dynamic_cast<VectorStat*>(child)) {
+            bool match = regex_match(name, filter);
+            for (uint32_t j = 0; j < vs->size(); j++, pos++) {
+                if (!match) continue;
+                const char* cn = vs->counterName(j);
+                names.push_back(name + "." + (cn? std::string(cn) : std::to_string(j)));
+                positions.push_back(pos);
+            }
+        } else if (dynamic_cast<ScalarStat*>(child)) {
+            if (regex_match(name, filter)) {
+                names.push_back(name);
+                positions.push_back(pos);
+            }
+            pos++;
+        }
+    }
+}
+
+void TraceSampler::beginSample() {
+    if (stats.empty()) {
+        std::vector<std::string> names;
+        std::vector<uint32_t> positions;
+        uint32_t pos = 0;
+        FlattenStats(zinfo->rootStat, std::regex(statsRegex), "", names, positions, pos);
+        if (names.empty()) panic("TraceSampler: no stats match sampleStats regex \"%s\"", statsRegex.c_str());
+        for (uint32_t i = 0; i < names.size(); i++) {
+            StatEntry e = {names[i], positions[i]};
+            stats.push_back(e);
+        }
+        flatStats = new FlatStats(zinfo->rootStat);
+        assert(flatStats->size() == pos);
+        sampleStart.resize(pos);
+        sampleEnd.resize(pos);
+        sampleDelta.resize(pos);
+        sum.resize(stats.size(), 0.0);
+        sumSq.resize(stats.size(), 0.0);
+    }
+    flatStats->snapshot(sampleStart.data());
+}
+
+void TraceSampler::endSample() {
+    double weight = 1.0;
+    if (mode == CLUSTERED) {
+        uint64_t pos = std::lower_bound(selected.begin(), selected.end(), curInterval) - selected.begin();
+        assert(pos < selected.size() && selected[pos] == curInterval);
+        weight = weights[pos];
+    }
+    flatStats->snapshot(sampleEnd.data());
+    FlatStats::diff(sampleEnd.data(), sampleStart.data(), sampleDelta.data(), sampleDelta.size());
+    for (uint32_t i = 0; i < stats.size(); i++) {
+        double delta = (double)sampleDelta[stats[i].pos];
+        sum[i] += weight*delta;
+        sumSq[i] += delta*delta;
+    }
+    numSamples++;
+    writeReport(false);
+}
+
+void TraceSampler::finish() {
+    // A measured interval cut short by the end of the trace is not representative, so it is dropped
+    region = SKIP;
+    regionEnd = -1;
+    writeReport(true);
+    info("TraceSampler: %ld samples of %ld intervals, %ld trace cycles skipped", numSamples, numIntervals, skippedCycles);
+}
+
+void TraceSampler::writeReport(bool final) {
+    FILE* f = fopen(reportFile.c_str(), "w");
+    if (!f) {
+        warn("TraceSampler: could not open %s", reportFile.c_str());
+        return;
+    }
+    const char* modeNames[] = {"Systematic", "Random", "Clustered"};
+    fprintf(f, "# Sampled simulation (%s), %s\n", modeNames[mode], final? "final" : "in progress");
+    fprintf(f, "# intervals: %ld x %ld cycles, samples: %ld, warmup: %ld cycles, skipped: %ld cycles\n",
+            numIntervals, intervalCycles, numSamples, warmupCycles, skippedCycles);
+    fprintf(f, "# stat estimate ci95 sampleMean\n");
+    double n = numSamples;
+    double N = MAX(numIntervals, numSamples);
+    for (uint32_t i = 0; i < stats.size(); i++) {
+        if (mode == CLUSTERED) {
+            // Weights add up to the number of intervals
+            fprintf(f, "%s %.0f - %.2f\n", stats[i].name.c_str(), sum[i], (n > 0)? sum[i]/N : 0.0);
+        } else if (n > 1) {
+            double mean = sum[i]/n;
+            double var = MAX(0.0, (sumSq[i] - sum[i]*mean)/(n - 1));
+            double ci = 1.96*N*sqrt(var/n)*sqrt(MAX(0.0, 1.0 - n/N));  // with finite population correction
+            fprintf(f, "%s %.0f %.0f %.2f\n", stats[i].name.c_str(), N*mean, ci, mean);
+        } else {
+            fprintf(f, "%s %.0f - %.2f\n", stats[i].name.c_str(), N*sum[i], sum[i]);
+        }
+    }
+    fclose(f);
+}
@@ -0,0 +1,117 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_SAMPLER_H_
+#define TRACE_SAMPLER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "g_std/g_string.h"
+#include "log.h"
+#include "stats.h"
+#include "stats_arena.h"
+
+/* Sampled trace-driven simulation. The trace is split in fixed-size
+ * intervals of trace cycles, and only some are measured, each preceded by a
+ * warmup window that is replayed but not measured. Records outside these
+ * windows are skipped, and skipped cycles are removed from the simulated
+ * timeline. Selection modes:
+ *  - Systematic: the last interval of every period intervals.
+ *  - Random: one random interval per period intervals (stratified).
+ *  - Clustered: SimPoint-style. A profiling pass builds a memory footprint
+ *    vector per interval (accesses per hashed page, normalized), k-means
+ *    clusters them, and the interval closest to each centroid is measured,
+ *    weighted by its cluster's size.
+ * The deltas of the selected stats over each measured interval are
+ * extrapolated to the full trace, with 95% confidence intervals for the
+ * systematic and random modes, and written to zsim-sampling.out.
+ */
+
+class TraceSampler {
+    public:
+        enum Mode {SYSTEMATIC, RANDOM, CLUSTERED};
+
+    private:
+        enum Region {SKIP, WARMUP, MEASURE};
+
+        const Mode mode;
+        const uint64_t intervalCycles;
+        const uint64_t period;
+        const uint64_t warmupCycles;
+        const uint64_t seed;
+        const std::string statsRegex;
+        const g_string reportFile;
+
+        // Clustered mode: measured intervals (sorted) and their weights (intervals represented)
+        std::vector<uint64_t> selected;
+        std::vector<uint64_t> weights;
+        uint64_t numIntervals;  // known upfront with clustering; otherwise, seen so far
+
+        // Current region, in trace cycles [regionStart, regionEnd)
+        Region region;
+        uint64_t regionStart;
+        uint64_t regionEnd;
+        uint64_t replayEnd;  // end of the last replayed region
+        uint64_t skippedCycles;  // subtracted from trace cycles
+        uint64_t curInterval;  // of the last region change
+
+        // Stats, flattened on the first sample. Samples snapshot the whole stats tree, which is cheap with
+        // arena-backed counters, and the selected stats are picked from the snapshot deltas.
+        struct StatEntry {
+            std::string name;
+            uint32_t pos;  // in the snapshot
+        };
+        std::vector<StatEntry> stats;
+        FlatStats* flatStats;
+        std::vector<uint64_t> sampleStart, sampleEnd, sampleDelta;
+        std::vector<double> sum, sumSq;  // per stat, of per-sample deltas (weighted in clustered mode)
+        uint64_t numSamples;
+
+    public:
+        TraceSampler(Mode _mode, uint64_t _intervalCycles, uint64_t _period, uint64_t _warmupCycles, uint32_t numClusters,
+                uint64_t _seed, const char* _statsRegex, const std::string& traceFile, const g_string& _reportFile);
+
+        // Returns false if the record at this trace cycle should be skipped; otherwise, sets the cycle to simulate it at
+        inline bool filter(uint64_t traceCycle, uint64_t* simCycle) {
+            if (unlikely(traceCycle >= regionEnd)) advance(traceCycle);
+            *simCycle = (traceCycle > skippedCycles)? traceCycle - skippedCycles : 0;  // traces may be slightly out of order
+            return region != SKIP;
+        }
+
+        // Call when the trace ends; writes the final report
+        void finish();
+
+    private:
+        void advance(uint64_t traceCycle);
+        uint64_t nextMeasured(uint64_t interval) const;  // first measured interval >= interval, or -1
+        void cluster(const std::string& traceFile, uint32_t numClusters);
+
+        void beginSample();
+        void endSample();
+        void writeReport(bool final);
+};
+
+#endif  // TRACE_SAMPLER_H_
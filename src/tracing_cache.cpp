@@ -27,7 +27,7 @@
 #include "zsim.h"
 
 TracingCache::TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, g_string& _name) :
-    Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), tracefile(_tracefile)
+    Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), tracefile(_tracefile), analytics(nullptr)
 {
     futex_init(&traceLock);
 }
@@ -39,12 +39,21 @@ void TracingCache::setChildren(const g_vector<BaseCache*>& children, Network* ne
     zinfo->traceWriters->push_back(atw); //register it so that it gets flushed when the simulation ends
 }
 
+void TracingCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* cacheStat = new AggregateStat();
+    cacheStat->init(name.c_str(), "Tracing cache stats");
+    initCacheStats(cacheStat);
+    if (analytics) analytics->initStats(cacheStat);
+    parentStat->append(cacheStat);
+}
+
 uint64_t TracingCache::access(MemReq& req) {
     uint64_t respCycle = Cache::access(req);
     futex_lock(&traceLock);
     uint32_t lat = respCycle - req.cycle;
     AccessRecord acc = {req.lineAddr, req.cycle, lat, req.childId, req.type};
     atw->write(acc);
+    if (analytics && (req.type == GETS || req.type == GETX)) analytics->record(req.lineAddr, req.cycle);
     futex_unlock(&traceLock);
     return respCycle;
 }
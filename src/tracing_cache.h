@@ -28,16 +28,20 @@
 
 #include "access_tracing.h"
 #include "cache.h"
+#include "trace_analytics.h"
 
 class TracingCache : public Cache {
     private:
         g_string tracefile;
         AccessTraceWriter* atw;
         lock_t traceLock;
+        TraceAnalytics* analytics; //optional, fed GETs at the trace tap point
 
     public:
         TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, g_string& _name);
+        void initAnalytics(TraceAnalytics* _analytics) {analytics = _analytics;}
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
+        void initStats(AggregateStat* parentStat);
         uint64_t access(MemReq& req);
 };
 
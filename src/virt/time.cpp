@@ -204,10 +204,9 @@ PostPatchFn PatchNanosleep(PrePatchArgs args) {
     else waitNsec = 0;
 
     uint64_t waitCycles = nsToCycles(waitNsec);
-    uint64_t waitPhases = waitCycles/zinfo->phaseLength + 1; //wait at least 1 phase
-    uint64_t wakeupPhase = zinfo->numPhases + waitPhases;
+    uint64_t wakeupCycle = zinfo->globPhaseCycles + waitCycles + 1; //threads wake up at phase boundaries, so this waits at least until the next phase
 
-    volatile uint32_t* futexWord = zinfo->sched->markForSleep(procIdx, args.tid, wakeupPhase);
+    volatile uint32_t* futexWord = zinfo->sched->markForSleep(procIdx, args.tid, wakeupCycle);
 
     // Save args
     ADDRINT arg0 = PIN_GetSyscallArgument(ctxt, std, 0);
@@ -223,7 +222,7 @@ PostPatchFn PatchNanosleep(PrePatchArgs args) {
     PIN_SetSyscallArgument(ctxt, std, 2, (ADDRINT)1 /*by convention, see sched code*/);
     PIN_SetSyscallArgument(ctxt, std, 3, (ADDRINT)nullptr);
 
-    return [isClock, wakeupPhase, arg0, arg1, arg2, arg3, rem](PostPatchArgs args) {
+    return [isClock, wakeupCycle, arg0, arg1, arg2, arg3, rem](PostPatchArgs args) {
         CONTEXT* ctxt = args.ctxt;
         SYSCALL_STANDARD std = args.std;
 
@@ -253,8 +252,8 @@ PostPatchFn PatchNanosleep(PrePatchArgs args) {
         // Handle remaining time stuff
         if (rem) {
             if (res == EINTR) {
-                assert(wakeupPhase >= zinfo->numPhases);  // o/w why is this EINTR...
-                uint64_t remainingCycles = wakeupPhase - zinfo->numPhases;
+                assert(wakeupCycle >= zinfo->globPhaseCycles);  // o/w why is this EINTR...
+                uint64_t remainingCycles = wakeupCycle - zinfo->globPhaseCycles;
                 uint64_t remainingNsecs = remainingCycles*1000/zinfo->freqMHz;
                 rem->tv_sec = remainingNsecs/1000000000;
                 rem->tv_nsec = remainingNsecs % 1000000000;
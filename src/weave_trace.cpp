@@ -0,0 +1,102 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "weave_trace.h"
+#include <string.h>
+
+WeaveTrace::WeaveTrace(const char* fileName, uint32_t _numDomains, uint32_t _bufRecords, uint64_t startPhase, uint64_t numPhases)
+    : numDomains(_numDomains), bufRecords(_bufRecords), firstPhase(startPhase), supPhase(numPhases? startPhase + numPhases : (uint64_t)-1L)
+{
+    if (bufRecords == 0) panic("Weave trace buffers need at least one record");
+    if (numDomains > (1 << 16)) panic("Weave trace records hold 16-bit domain ids, %d domains", numDomains);
+
+    file = fopen(fileName, "w");
+    if (!file) panic("Could not open weave trace file %s", fileName);
+    WeaveTraceHeader hdr = {WEAVE_TRACE_MAGIC, numDomains, (uint32_t)sizeof(WeaveTraceRecord)};
+    fwrite(&hdr, sizeof(hdr), 1, file);
+    futex_init(&fileLock);
+
+    domBufs = gm_calloc<DomainBuf>(numDomains);
+    for (uint32_t d = 0; d < numDomains; d++) {
+        domBufs[d].buf = gm_calloc<WeaveTraceRecord>(bufRecords);
+        domBufs[d].cur = 0;
+        // calloc'd cache entries have null names, which never match
+    }
+
+    info("Tracing weave phases [%ld, %ld) to %s, %d records/domain buffered", firstPhase, supPhase, fileName, bufRecords);
+}
+
+void WeaveTrace::initStats(AggregateStat* parentStat) {
+    AggregateStat* traceStat = new AggregateStat();
+    traceStat->init("weaveTrace", "Weave event trace stats");
+    profRecords.init("records", "Records written"); traceStat->append(&profRecords);
+    profTypes.init("types", "Event types seen"); traceStat->append(&profTypes);
+    profOverflows.init("overflows", "Buffers written out mid-phase because they filled up"); traceStat->append(&profOverflows);
+    parentStat->append(traceStat);
+}
+
+bool WeaveTrace::beginPhase(uint64_t phase, uint64_t limit) {
+    if (phase < firstPhase || phase >= supPhase) return false;
+    WeaveTraceRecord r = {limit, 0, phase, 0, 0, WT_PHASE, 0};
+    futex_lock(&fileLock);
+    fwrite(&r, sizeof(r), 1, file);
+    futex_unlock(&fileLock);
+    return true;
+}
+
+void WeaveTrace::endPhase() {
+    futex_lock(&fileLock);
+    for (uint32_t d = 0; d < numDomains; d++) flush(domBufs[d]);
+    fflush(file);
+    futex_unlock(&fileLock);
+}
+
+uint32_t WeaveTrace::internType(const char* name) {
+    futex_lock(&fileLock);
+    uint32_t id;
+    for (id = 0; id < types.size(); id++) {
+        if (types[id] == name || strcmp(types[id], name) == 0) break;
+    }
+    if (id == types.size()) {
+        types.push_back(name);
+        profTypes.inc();
+
+        uint64_t len = strlen(name);
+        WeaveTraceRecord r = {0, 0, len, id, 0, WT_TYPE, 0};
+        fwrite(&r, sizeof(r), 1, file);
+        char pad[8] = {0};
+        fwrite(name, 1, len, file);
+        fwrite(pad, 1, (8 - len % 8) % 8, file);
+    }
+    futex_unlock(&fileLock);
+    return id;
+}
+
+void WeaveTrace::flush(DomainBuf& db) {
+    if (!db.cur) return;
+    if (fwrite(db.buf, sizeof(WeaveTraceRecord), db.cur, file) != db.cur) panic("Weave trace write failed");
+    profRecords.inc(db.cur);
+    db.cur = 0;
+}
@@ -0,0 +1,146 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WEAVE_TRACE_H_
+#define WEAVE_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "log.h"
+#include "pad.h"
+#include "stats.h"
+
+/* Binary trace of weave-phase events, for offline analysis of what gates
+ * latency in the contention model (see weavetrace2json.cpp).
+ *
+ * Events append fixed-size records to a per-domain buffer. A domain is only
+ * simulated by one thread at a time, so buffers need no synchronization; a
+ * full buffer is written out by the thread that fills it, and all buffers are
+ * written out at the end of each traced phase. Event type names are interned
+ * and written to the file (as WT_TYPE records followed by the name) before
+ * any record that uses them.
+ *
+ * File layout: WeaveTraceHeader, then a stream of WeaveTraceRecords.
+ */
+
+#define WEAVE_TRACE_MAGIC 0x3245564157534d5aul  // "ZMSWAVE2"
+
+struct WeaveTraceHeader {
+    uint64_t magic;
+    uint32_t numDomains;
+    uint32_t recordSize;
+};
+
+enum WeaveTraceKind {
+    WT_RUN,       // ev's simulate() called at cycle (once per (re)queue)
+    WT_DONE,      // ev finished at cycle; arg = number of children, whose WT_EDGE records follow
+    WT_EDGE,      // ev's child arg becomes ready at cycle (ev's done cycle + postDelay); type is the child's.
+                  // Children that finish synchronously (e.g., delays) record their own WT_DONE and edges in
+                  // between, so the edges of nested done() calls form a stack per domain
+    WT_CROSSING,  // crossing ev released its child at cycle; arg = srcDomain << 32 | slack
+    WT_TYPE,      // defines type id type; arg = name length, name bytes follow, padded to 8 bytes
+    WT_PHASE,     // phase arg starts; cycle is the weave limit
+};
+
+struct WeaveTraceRecord {
+    uint64_t cycle;
+    uint64_t ev;  // event address; addresses are reused across phases
+    uint64_t arg;
+    uint32_t type;
+    uint16_t domain;
+    uint8_t kind;
+    uint8_t pad;
+};
+
+class WeaveTrace : public GlobAlloc {
+    private:
+        static const uint32_t TYPE_CACHE_SIZE = 32;  // per-domain, direct-mapped on the name pointer
+
+        struct DomainBuf {
+            WeaveTraceRecord* buf;
+            uint32_t cur;
+            const char* cachedNames[TYPE_CACHE_SIZE];
+            uint32_t cachedIds[TYPE_CACHE_SIZE];
+            PAD();
+        };
+
+        DomainBuf* domBufs;
+        const uint32_t numDomains;
+        const uint32_t bufRecords;
+        const uint64_t firstPhase, supPhase;  // traced phases are [firstPhase, supPhase)
+
+        FILE* file;
+        lock_t fileLock;  // protects file and types
+        g_vector<const char*> types;
+
+        Counter profRecords, profTypes, profOverflows;
+
+    public:
+        // numPhases == 0 traces every phase from startPhase on
+        WeaveTrace(const char* fileName, uint32_t _numDomains, uint32_t _bufRecords, uint64_t startPhase, uint64_t numPhases);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Called between phases; returns whether the phase that simulates up to limit is traced
+        bool beginPhase(uint64_t phase, uint64_t limit);
+        void endPhase();
+
+        inline void record(WeaveTraceKind kind, uint32_t domain, uint64_t cycle, const void* ev, const char* typeName, uint64_t arg) {
+            if (domain >= numDomains) return;  // not placed yet
+            DomainBuf& db = domBufs[domain];
+            WeaveTraceRecord& r = db.buf[db.cur];
+            r.cycle = cycle;
+            r.ev = (uint64_t)ev;
+            r.arg = arg;
+            r.type = typeId(db, typeName);
+            r.domain = domain;
+            r.kind = kind;
+            r.pad = 0;
+            if (unlikely(++db.cur == bufRecords)) {
+                futex_lock(&fileLock);
+                flush(db);
+                profOverflows.inc();
+                futex_unlock(&fileLock);
+            }
+        }
+
+    private:
+        inline uint32_t typeId(DomainBuf& db, const char* name) {
+            uint32_t idx = (((uint64_t)name) >> 3) % TYPE_CACHE_SIZE;
+            if (likely(db.cachedNames[idx] == name)) return db.cachedIds[idx];
+            uint32_t id = internType(name);
+            db.cachedNames[idx] = name;
+            db.cachedIds[idx] = id;
+            return id;
+        }
+
+        uint32_t internType(const char* name);
+        void flush(DomainBuf& db);  // caller holds fileLock
+};
+
+#endif  // WEAVE_TRACE_H_
@@ -0,0 +1,238 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Converts a weave event trace (see weave_trace.h) to the Chrome trace event
+ * JSON format, which chrome://tracing and ui.perfetto.dev can open. Each
+ * domain is a thread, each event a slice from its first simulate() call to
+ * its done cycle, and cycles are shown as microseconds. Each event is linked
+ * by a flow arrow to its critical parent, i.e., the parent whose completion
+ * made it ready (the last one to arrive), so following arrows backwards from
+ * a memory response walks the chain of events that gated its latency.
+ *
+ * With -s, prints instead a per-type summary: event counts, average
+ * duration, and how often each type was the critical parent.
+ */
+
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "log.h"
+#include "weave_trace.h"
+
+struct EvState {
+    uint64_t id;
+    uint64_t firstRun;
+    uint64_t readyCycle;  // cycle at which the last parent edge arrived
+    uint32_t runs;
+    uint32_t type;
+    uint32_t domain;
+    bool hasCrit;
+    uint32_t critDomain;
+    uint32_t critType;
+    uint64_t critCycle;  // done cycle of the critical parent
+    uint64_t crossingArg;
+    bool crossing;
+};
+
+struct DoneInfo {  // a finished event whose edges have not all been seen yet
+    uint64_t addr;
+    uint32_t type;
+    uint64_t doneCycle;
+    uint64_t edgesLeft;
+};
+
+struct TypeSummary {
+    uint64_t count;
+    uint64_t totalCycles;
+    uint64_t critCount;
+};
+
+static std::string demangle(const std::string& name) {
+    int status;
+    char* res = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (status != 0) return name;
+    std::string s(res);
+    free(res);
+    return s;
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    bool summary = false;
+    int argIdx = 1;
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        summary = true;
+        argIdx++;
+    }
+    if (argc - argIdx != (summary? 1 : 2)) {
+        info("Converts a weave event trace to Chrome trace event JSON, or summarizes it (-s)");
+        info("Usage: %s <trace> <out.json>", argv[0]);
+        info("       %s -s <trace>", argv[0]);
+        exit(1);
+    }
+
+    FILE* in = fopen(argv[argIdx], "r");
+    if (!in) panic("Could not open %s", argv[argIdx]);
+    WeaveTraceHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != WEAVE_TRACE_MAGIC) panic("%s is not a weave trace", argv[argIdx]);
+    if (hdr.recordSize != sizeof(WeaveTraceRecord)) panic("Trace has %d-byte records, expected %ld", hdr.recordSize, sizeof(WeaveTraceRecord));
+
+    FILE* out = nullptr;
+    if (!summary) {
+        out = fopen(argv[argIdx + 1], "w");
+        if (!out) panic("Could not open %s", argv[argIdx + 1]);
+        fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+        fprintf(out, "{\"ph\": \"M\", \"pid\": 0, \"name\": \"process_name\", \"args\": {\"name\": \"weave\"}}");
+        for (uint32_t d = 0; d < hdr.numDomains; d++) {
+            fprintf(out, ",\n{\"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": \"domain %d\"}}", d, d);
+        }
+    }
+
+    std::vector<std::string> types;
+    std::vector<TypeSummary> typeSummaries;
+    std::unordered_map<uint64_t, EvState> live;  // keyed by address, valid until the event's WT_DONE
+    // Per domain, the done() calls whose edges are still being recorded. A child that finishes inside its
+    // parent's done() (e.g., a delay) records its done and edges between two of its parent's edges.
+    std::vector<std::vector<DoneInfo>> openDones(hdr.numDomains);
+    uint64_t nextId = 0;
+    uint64_t nextFlow = 0;
+    uint64_t numRecords = 0;
+
+    auto getState = [&](uint64_t addr, uint32_t type, uint32_t domain) -> EvState& {
+        auto it = live.find(addr);
+        if (it != live.end()) return it->second;
+        EvState& s = live[addr];
+        memset(&s, 0, sizeof(s));
+        s.id = nextId++;
+        s.type = type;
+        s.domain = domain;
+        return s;
+    };
+
+    WeaveTraceRecord r;
+    while (fread(&r, sizeof(r), 1, in) == 1) {
+        numRecords++;
+        switch (r.kind) {
+            case WT_TYPE: {
+                std::string name(r.arg, '\0');
+                if (fread(&name[0], 1, r.arg, in) != r.arg) panic("Truncated type name");
+                fseek(in, (8 - r.arg % 8) % 8, SEEK_CUR);
+                if (r.type >= types.size()) {
+                    types.resize(r.type + 1);
+                    typeSummaries.resize(r.type + 1, TypeSummary{0, 0, 0});
+                }
+                types[r.type] = demangle(name);
+                break;
+            }
+            case WT_PHASE:
+                if (out) fprintf(out, ",\n{\"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": 0, \"ts\": %ld, \"name\": \"phase %ld limit\"}", r.cycle, r.arg);
+                break;
+            case WT_RUN: {
+                EvState& s = getState(r.ev, r.type, r.domain);
+                if (s.runs++ == 0) s.firstRun = r.cycle;
+                s.domain = r.domain;
+                break;
+            }
+            case WT_CROSSING: {
+                EvState& s = getState(r.ev, r.type, r.domain);
+                s.crossing = true;
+                s.crossingArg = r.arg;
+                break;
+            }
+            case WT_EDGE: {
+                if (r.domain >= hdr.numDomains || openDones[r.domain].empty() || openDones[r.domain].back().addr != r.ev) {
+                    panic("Edge from %lx without a preceding done record", r.ev);
+                }
+                DoneInfo p = openDones[r.domain].back();
+                if (--openDones[r.domain].back().edgesLeft == 0) openDones[r.domain].pop_back();
+                EvState& s = getState(r.arg, r.type, r.domain);
+                if (!s.hasCrit || r.cycle >= s.readyCycle) {
+                    s.hasCrit = true;
+                    s.readyCycle = r.cycle;
+                    s.critDomain = r.domain;
+                    s.critType = p.type;
+                    s.critCycle = p.doneCycle;
+                }
+                break;
+            }
+            case WT_DONE: {
+                EvState& s = getState(r.ev, r.type, r.domain);
+                // Events that complete without being simulated (e.g., delays) start when they become ready
+                uint64_t start = s.runs? s.firstRun : (s.hasCrit? std::min(s.readyCycle, r.cycle) : r.cycle);
+                uint64_t dur = r.cycle - std::min(start, r.cycle);
+                if (r.type < typeSummaries.size()) {
+                    typeSummaries[r.type].count++;
+                    typeSummaries[r.type].totalCycles += dur;
+                }
+                if (s.hasCrit && s.critType < typeSummaries.size()) typeSummaries[s.critType].critCount++;
+
+                if (out) {
+                    const char* name = (r.type < types.size())? types[r.type].c_str() : "?";
+                    fprintf(out, ",\n{\"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %ld, \"dur\": %ld, \"name\": \"%s\", \"args\": {\"id\": %ld, \"runs\": %d",
+                            r.domain, start, dur, name, s.id, s.runs);
+                    if (s.crossing) fprintf(out, ", \"srcDomain\": %ld, \"slack\": %ld", s.crossingArg >> 32, s.crossingArg & 0xffffffff);
+                    if (s.hasCrit) {
+                        const char* critName = (s.critType < types.size())? types[s.critType].c_str() : "?";
+                        fprintf(out, ", \"critParent\": \"%s\", \"readyCycle\": %ld", critName, s.readyCycle);
+                    }
+                    fprintf(out, "}}");
+                    if (s.hasCrit) {
+                        uint64_t flow = nextFlow++;
+                        fprintf(out, ",\n{\"ph\": \"s\", \"pid\": 0, \"tid\": %d, \"ts\": %ld, \"id\": %ld, \"name\": \"crit\", \"cat\": \"dep\"}",
+                                s.critDomain, s.critCycle, flow);
+                        fprintf(out, ",\n{\"ph\": \"f\", \"bp\": \"e\", \"pid\": 0, \"tid\": %d, \"ts\": %ld, \"id\": %ld, \"name\": \"crit\", \"cat\": \"dep\"}",
+                                r.domain, start, flow);
+                    }
+                }
+
+                if (r.arg) openDones[r.domain].push_back(DoneInfo{r.ev, r.type, r.cycle, r.arg});
+                live.erase(r.ev);
+                break;
+            }
+            default:
+                panic("Unknown record kind %d after %ld records", r.kind, numRecords);
+        }
+    }
+    fclose(in);
+
+    if (out) {
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        info("Converted %ld records, %ld events (%ld still in flight at the end)", numRecords, nextId, live.size());
+    } else {
+        info("%ld records, %ld events, %ld still in flight at the end", numRecords, nextId, live.size());
+        info("%50s %12s %10s %12s", "Type", "Events", "AvgCycles", "CritParent");
+        for (uint32_t t = 0; t < types.size(); t++) {
+            const TypeSummary& ts = typeSummaries[t];
+            info("%50s %12ld %10.1f %12ld", types[t].c_str(), ts.count, ts.count? ((double)ts.totalCycles)/ts.count : 0.0, ts.critCount);
+        }
+    }
+
+    return 0;
+}
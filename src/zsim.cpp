@@ -44,6 +44,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "access_tracing.h"
+#include "mem_trace.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
@@ -56,6 +57,7 @@
 #include "log.h"
 #include "pin.H"
 #include "pin_cmd.h"
+#include "phase_controller.h"
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "scheduler.h"
@@ -1117,6 +1119,7 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        for (MemTraceWriter* t : *(zinfo->memTraceWriters)) t->flush();
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
@@ -1562,6 +1565,7 @@ int main(int argc, char *argv[]) {
             EndOfPhaseActions();
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            if (zinfo->phaseController) zinfo->phaseController->update();
         }
         info("Finished trace-driven simulation");
         SimEnd();
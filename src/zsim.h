@@ -42,11 +42,13 @@ class ProcessStats;
 class ProcStats;
 class EventQueue;
 class ContentionSim;
+class PhaseLengthController;
 class EventRecorder;
 class PinCmd;
 class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
+class MemTraceWriter;
 class TraceDriver;
 template <typename T> class g_vector;
 
@@ -93,7 +95,9 @@ struct GlobSimInfo {
     PAD();
 
     //World-readable
-    uint32_t phaseLength;
+    uint32_t phaseLength; //may change between phases if phaseController is set
+    uint32_t maxPhaseLength;
+    PhaseLengthController* phaseController; //nullptr unless sim.adaptivePhase
     uint32_t statsPhaseInterval;
     uint32_t freqMHz;
 
@@ -177,6 +181,7 @@ struct GlobSimInfo {
 
     // Trace writers (stored globally because they need to be deleted when the simulation ends)
     g_vector<AccessTraceWriter*>* traceWriters;
+    g_vector<MemTraceWriter*>* memTraceWriters;  // memory controller traces (sys.mem.enableTrace)
 
     // Trace-driven simulation (no cores)
     bool traceDriven;
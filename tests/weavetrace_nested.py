@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Checks that weavetrace2json handles events that finish inside their parent's
+# done(), as delays do: their done and edge records come between two of the
+# parent's edges. Usage: weavetrace_nested.py <path to weavetrace2json>
+
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = 0x3245564157534d5a  # "ZMSWAVE2"
+WT_RUN, WT_DONE, WT_EDGE, WT_CROSSING, WT_TYPE, WT_PHASE = range(6)
+
+def record(kind, cycle, ev, arg, type, domain=0):
+    return struct.pack("<QQQIHBB", cycle, ev, arg, type, domain, kind, 0)
+
+def typedef(type, name):
+    name = name.encode()
+    return record(WT_TYPE, 0, 0, len(name), type) + name + b"\0" * ((8 - len(name) % 8) % 8)
+
+PARENT, DELAY, CHILD = 0x100, 0x200, 0x300
+trace = struct.pack("<QII", MAGIC, 1, 32)
+trace += typedef(0, "Parent") + typedef(1, "DelayEvent") + typedef(2, "Child") + typedef(3, "Sibling")
+trace += record(WT_PHASE, 1000, 0, 0, 0)
+trace += record(WT_RUN, 10, PARENT, 0, 0)
+trace += record(WT_DONE, 20, PARENT, 2, 0)
+trace += record(WT_EDGE, 20, PARENT, DELAY, 1)
+trace += record(WT_DONE, 25, DELAY, 1, 1)        # the delay finishes inside the parent's done()...
+trace += record(WT_EDGE, 25, DELAY, CHILD, 2)
+trace += record(WT_EDGE, 20, PARENT, 0x400, 3)   # ...before the parent's second edge
+trace += record(WT_RUN, 25, CHILD, 0, 2)
+trace += record(WT_DONE, 30, CHILD, 0, 2)
+trace += record(WT_RUN, 20, 0x400, 0, 3)
+trace += record(WT_DONE, 28, 0x400, 0, 3)
+
+tmp = tempfile.mkdtemp()
+traceFile = os.path.join(tmp, "nested.trace")
+jsonFile = os.path.join(tmp, "nested.json")
+with open(traceFile, "wb") as f:
+    f.write(trace)
+subprocess.check_call([sys.argv[1], traceFile, jsonFile])
+events = {e["name"]: e for e in json.load(open(jsonFile))["traceEvents"] if e["ph"] == "X"}
+assert events["Child"]["args"]["critParent"] == "DelayEvent", events["Child"]
+assert events["Sibling"]["args"]["critParent"] == "Parent", events["Sibling"]
+assert events["DelayEvent"]["args"]["critParent"] == "Parent", events["DelayEvent"]
+print("OK")